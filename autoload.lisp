@@ -78,21 +78,5 @@
 	(> start end) (cons start (range (- start 1) end))))
 
 
-;; String stuff
-(defun is-lower (char)
-  (and (>= char (car "a")) (<= char (car "z"))))
-(defun is-upper (char)
-  (and (>= char (car "A")) (<= char (car "Z"))))
-(defun is-digit (char)
-  (and (>= char (car "0")) (<= char (car "9"))))
-(defun to-upper (char)
-  (if (is-lower char)
-      (+ char (- (car "A") (car "a")))
-      char))
-(defun to-lower (char)
-  (if (is-upper char)
-      (+ char (- (car "a") (car "A")))
-      char))
-
 (let (words '(Finished loading standard library.))
   (printnl . words))
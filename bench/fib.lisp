@@ -0,0 +1,7 @@
+;; Function call and fixnum arithmetic overhead: doubly recursive
+;;  Fibonacci.  Run with `time`.
+;; calls: 2692537
+(defun fib (n)
+  (if (< n 2) n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 30)
@@ -0,0 +1,14 @@
+;; Collection time for a deeply nested structure: a chain of 200,000
+;;  conses linked through their cars, which is the worst case for a
+;;  collector that recurses on car.  Run with `time`.  Calls are to gc.
+;; calls: 101
+(defun nest (x n)
+  (if (= n 0) x (nest (cons x nil) (- n 1))))
+(defun grow (x k)
+  (if (= k 0) x (grow (nest x 1000) (- k 1))))
+
+(set deep (grow nil 200))
+
+(defun collect (n)
+  (if (= n 0) (gc) (do (gc) (collect (- n 1)))))
+(collect 100)
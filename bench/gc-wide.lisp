@@ -0,0 +1,11 @@
+;; Collection time for a wide structure: 2,000 lists of 100 elements
+;;  hanging off one long spine.  Run with `time`.  Calls are to gc.
+;; calls: 101
+(defun wide (k)
+  (if (= k 0) nil (cons (range 1 100) (wide (- k 1)))))
+
+(set wide-list (wide 2000))
+
+(defun collect (n)
+  (if (= n 0) (gc) (do (gc) (collect (- n 1)))))
+(collect 100)
@@ -0,0 +1,11 @@
+;; The sequence functions from autoload.lisp over a long list: each
+;;  pass filters 10,000 numbers, maps over the 5,000 left and folds
+;;  them up, and there are 100 passes.  Calls are to the lambdas.
+;; calls: 1500000
+(set xs (range 1 10000))
+(defun pass (k acc)
+  (if (= k 0) acc
+      (pass (- k 1)
+	    (+ acc (foldl + 0 (map (lambda (x) (* x 3))
+				   (filter (lambda (x) (= (% x 2) 0)) xs)))))))
+(pass 100 0)
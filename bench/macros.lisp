@@ -0,0 +1,17 @@
+;; Code written with the macros from autoload.lisp, let, if, when and
+;;  unless, rather than with cond and lambda.  Calls are to loop.
+;; calls: 1000000
+(defun clamp (x lo hi)
+  (let (below (< x lo)
+	above (> x hi))
+    (if below lo
+	(if above hi x))))
+(defun loop (n acc)
+  (if (= n 0) acc
+      (let (y (clamp (% n 100) 20 80))
+	(when (> y 50)
+	  (set acc (+ acc y)))
+	(unless (> y 50)
+	  (set acc (- acc 1)))
+	(loop (- n 1) acc))))
+(loop 1000000 0)
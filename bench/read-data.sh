@@ -0,0 +1,12 @@
+#!/bin/sh
+# Writes MB megabytes (1 by default) of quoted data to stdout, the
+#  same every time: symbols, numbers, strings and nested lists, one
+#  form a line.  Used by read.sh and run.sh.
+awk -v mb="${1:-1}" 'BEGIN {
+  for (n = 0; bytes < mb * 1048576; n++) {
+    line = sprintf("(quote (sym-%d %d \"str %d\" (nested (list of-%d)) -%d . tail))",
+		   n % 5000, n, n, n % 37, n * 7)
+    print line
+    bytes += length(line) + 1
+  }
+}'
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Reader throughput: generates a file of quoted data (symbols, numbers,
+#  strings and nested lists), loads it from the command line, where it
+#  is mapped into memory, and again through stdin, and reports MB/s for
+#  each.  Run from the top directory after building; the size in MB
+#  can be given as an argument.  The interpreter is $LISP, or else the
+#  binary make builds, named for the top directory.
+MB=${1:-32}
+LISP=${LISP:-./$(basename "$PWD")}
+DATA=$(mktemp)
+EMPTY=$(mktemp)
+trap 'rm -f "$DATA" "$EMPTY"' EXIT
+
+sh "$(dirname "$0")/read-data.sh" "$MB" > "$DATA"
+SIZE=$(wc -c < "$DATA")
+
+now() { date +%s.%N; }
+run() {
+  START=$(now)
+  "$@" > /dev/null
+  END=$(now)
+  echo "$START $END" | awk '{print $2 - $1}'
+}
+
+# Startup, which includes loading autoload.lisp, is measured on its own
+#  and taken off.
+BASE=$(run "$LISP" "$EMPTY" < /dev/null)
+MAPPED=$(run "$LISP" "$DATA" < /dev/null)
+STREAM=$(run "$LISP" < "$DATA")
+echo "$SIZE $BASE $MAPPED" | awk '{printf "mapped: %.1f MB/s\n", $1 / 1048576 / ($3 - $2)}'
+echo "$SIZE $BASE $STREAM" | awk '{printf "stdin:  %.1f MB/s (with printing)\n", $1 / 1048576 / ($3 - $2)}'
@@ -0,0 +1,115 @@
+#!/bin/sh
+# Runs the benchmark suite and prints one tab-separated line for each
+#  workload: its name, the best wall time in seconds of several runs,
+#  nanoseconds per call, conses made and the peak size of the cons
+#  store in cells.  Run from the top directory after building, or with
+#  `make bench`.
+#
+#   bench/run.sh [-n RUNS] [-s FILE] [-c FILE] [-t PERCENT] [NAME...]
+#
+# -s saves the results to FILE as a baseline, and -c compares them
+#  against one, adding the baseline's ns per call and the change.  A
+#  workload more than PERCENT (10 by default) slower, or making more
+#  conses, is marked REGRESSION and makes the exit status 1.  Names
+#  pick workloads out of bench/*.lisp, and "read"; all run otherwise.
+#
+# The interpreter is $LISP, or else the binary make builds, named for
+#  the top directory.
+#
+# Each .lisp file says how many calls it makes in a ";; calls: N"
+#  line; the reader workload counts forms.  Startup, which includes
+#  loading autoload.lisp, is measured on its own and taken off.
+RUNS=3
+SAVE=
+COMPARE=
+THRESHOLD=10
+while getopts n:s:c:t: opt; do
+  case $opt in
+    n) RUNS=$OPTARG ;;
+    s) SAVE=$OPTARG ;;
+    c) COMPARE=$OPTARG ;;
+    t) THRESHOLD=$OPTARG ;;
+    *) exit 2 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+LISP=${LISP:-./$(basename "$PWD")}
+[ -x "$LISP" ] || { echo "bench/run.sh: build first" >&2; exit 2; }
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+: > "$TMP/empty.lisp"
+
+sh bench/read-data.sh 4 > "$TMP/read.lisp"
+READ_CALLS=$(wc -l < "$TMP/read.lisp")
+
+now() { date +%s.%N; }
+
+# Prints the best time of RUNS runs of the file, leaving the stats
+#  from the last of them in $TMP/stats.
+best() {
+  for n in $(seq "$RUNS"); do
+    START=$(now)
+    LISP_STATS=1 "$LISP" "$1" < /dev/null > /dev/null 2> "$TMP/stats"
+    END=$(now)
+    echo "$START $END"
+  done | awk 'NR == 1 || $2 - $1 < best {best = $2 - $1} END {print best}'
+}
+
+stat() { awk -v key="$1" '$1 == key {print $2}' "$TMP/stats"; }
+
+# name file calls
+measure() {
+  WALL=$(best "$2")
+  echo "$1 $WALL $BASE $3 $(stat conses) $(stat store-cells)" | awk '{
+    wall = $2 - $3
+    if (wall < 0) wall = 0
+    printf "%s\t%.4f\t%.1f\t%d\t%d\n", $1, wall, wall * 1e9 / $4, $5, $6
+  }'
+}
+
+wanted() {
+  [ $# -eq 1 ] && return 0
+  NAME=$1
+  shift
+  for arg; do [ "$arg" = "$NAME" ] && return 0; done
+  return 1
+}
+
+BASE=$(best "$TMP/empty.lisp")
+{
+  for file in bench/*.lisp; do
+    name=$(basename "$file" .lisp)
+    wanted "$name" "$@" || continue
+    calls=$(awk '/^;; calls: *[0-9]+/ {print $3; exit}' "$file")
+    measure "$name" "$file" "${calls:-1}"
+  done
+  if wanted read "$@"; then
+    measure read "$TMP/read.lisp" "$READ_CALLS"
+  fi
+} > "$TMP/results"
+
+[ -n "$SAVE" ] && cp "$TMP/results" "$SAVE"
+
+if [ -z "$COMPARE" ]; then
+  printf 'name\twall_s\tns_per_call\tconses\tstore_cells\n'
+  cat "$TMP/results"
+  exit 0
+fi
+
+printf 'name\twall_s\tns_per_call\tconses\tstore_cells\tbase_ns_per_call\tchange_pct\n'
+awk -v limit="$THRESHOLD" -F '\t' '
+  NR == FNR {ns[$1] = $3; conses[$1] = $4; next}
+  {
+    line = $0
+    if (!($1 in ns)) {print line "\t-\t-"; next}
+    change = ns[$1] > 0? ($3 - ns[$1]) * 100 / ns[$1] : 0
+    line = sprintf("%s\t%.1f\t%+.1f", line, ns[$1], change)
+    if (change > limit || $4 > conses[$1]) {
+      line = line "\tREGRESSION"
+      bad = 1
+    }
+    print line
+  }
+  END {exit bad}' "$COMPARE" "$TMP/results"
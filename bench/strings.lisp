@@ -0,0 +1,12 @@
+;; String processing: a sentence is upper-cased a word at a time and
+;;  joined up again, then lower-cased as a whole.  Calls are to
+;;  to-upper.
+;; calls: 900000
+(set words (list "the" "quick" "brown" "fox" "jumps" "over" "the" "lazy" "dog"))
+(defun shout (ws)
+  (if (null? ws) ""
+      (string-append (to-upper (car ws)) " " (shout (cdr ws)))))
+(defun loop (n total)
+  (if (= n 0) total
+      (loop (- n 1) (+ total (string-length (to-lower (shout words)))))))
+(loop 100000 0)
@@ -0,0 +1,10 @@
+;; Function call overhead with three arguments: the Takeuchi function.
+;;  Run with `time`.
+;; calls: 2493349
+(defun tak (x y z)
+  (if (< y x)
+      (tak (tak (- x 1) y z)
+	   (tak (- y 1) z x)
+	   (tak (- z 1) x y))
+      z))
+(tak 24 16 8)
@@ -0,0 +1,22 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stdio.h>
+#include "lisp.h"
+
+// Arithmetic on integers in either representation, giving a mint
+//  whenever the result fits in one.  These may allocate a bignum, so
+//  the arguments have to be rooted.
+obj_t int_add(obj_t a, obj_t b);
+obj_t int_sub(obj_t a, obj_t b);
+obj_t int_mul(obj_t a, obj_t b);
+int int_compare(obj_t a, obj_t b);
+
+// Reads an integer literal of any size, with an optional sign and
+//  with its base given by its prefix as for strtol(), or returns nil
+//  if that isn't all the string holds.
+obj_t parse_integer(const char *str);
+
+void print_bignum(bignum_t *num, FILE *out);
+
+#endif // BIGNUM_H
@@ -6,30 +6,81 @@
 
 extern obj_t nil, t;
 
-typedef obj_t builtin_t(obj_t);
+// Special forms get their argument list unevaluated.
+typedef obj_t special_t(obj_t);
+
+// Builtins get their evaluated arguments as a vector, which lives on
+//  the value stack for the duration of the call.  Their arity, as
+//  given in the table in builtins.c, has already been checked.
+typedef obj_t builtin_t(size_t argc, obj_t *argv);
+
+// Direct entry points for calls with exactly one or two arguments,
+//  which skip the vector.
+typedef obj_t builtin1_t(obj_t);
+typedef obj_t builtin2_t(obj_t, obj_t);
 
 // Special forms
-builtin_t op_cond, op_quote, op_quasiquote, op_lambda, op_mu, op_do;
-builtin_t op_set, op_def, op_and, op_or;
+special_t op_cond, op_quote, op_quasiquote, op_lambda, op_mu, op_do;
+special_t op_set, op_def, op_and, op_or, op_profile, op_lambda_star;
 extern obj_t unquote, unquote_splice; // need access to implement `
+obj_t nappend(obj_t a, obj_t b);
+
+// What set and def do to each variable, shared with compiled code.
+void def_sym(obj_t name, obj_t val);
+void set_sym(obj_t name, obj_t val);
 
 // The basic predicates
-builtin_t fn_consp, fn_nullp, fn_symp, fn_mintp, fn_funp;
+builtin_t fn_consp, fn_nullp, fn_symp, fn_mintp, fn_integerp, fn_funp;
 builtin_t fn_less, fn_greater, fn_lesseq, fn_greatereq;
 builtin_t fn_equal, fn_notequal;
+builtin1_t fn1_consp, fn1_nullp, fn1_symp, fn1_mintp, fn1_integerp, fn1_funp;
+builtin2_t fn2_less, fn2_greater, fn2_lesseq, fn2_greatereq;
+builtin2_t fn2_equal, fn2_notequal;
 
 // Arithmetic functions
 builtin_t fn_add, fn_mul, fn_sub, fn_div, fn_mod;
+builtin2_t fn2_add, fn2_mul, fn2_sub, fn2_mod;
 
 // List functions
-builtin_t fn_list, fn_cons, fn_car, fn_cdr;
+builtin_t fn_list, fn_cons, fn_car, fn_cdr, fn_rplaca, fn_rplacd;
+builtin2_t fn2_rplaca, fn2_rplacd;
+
+// String and character functions
+builtin_t fn_stringp, fn_string_length, fn_string_ref, fn_substring;
+builtin_t fn_string_append, fn_string_equal;
+builtin_t fn_string_to_list, fn_list_to_string;
+builtin_t fn_is_lower, fn_is_upper, fn_is_digit, fn_to_upper, fn_to_lower;
+builtin1_t fn1_string_length;
+builtin2_t fn2_string_ref;
+
+// Vector functions
+builtin_t fn_vectorp, fn_vector, fn_make_vector, fn_vector_length;
+builtin_t fn_vector_ref, fn_vector_set, fn_vector_to_list, fn_list_to_vector;
+builtin1_t fn1_vector_length;
+builtin2_t fn2_vector_ref;
+
+// Hash table functions
+builtin_t fn_tablep, fn_make_hash, fn_hash_get, fn_hash_put, fn_hash_remove;
+builtin_t fn_hash_count, fn_hash_keys, fn_hash_to_list;
 
 // Little bits of magic
-builtin_t fn_error, fn_eval, fn_print, fn_printnl;
+builtin_t fn_error, fn_eval, fn_apply, fn_print, fn_printnl, fn_gc;
+builtin_t fn_gc_stats;
+
+// Profiling
+builtin_t fn_profile_start, fn_profile_stop;
 
 
+size_t index_arg(obj_t obj, size_t limit);
+obj_t list_from_args(size_t argc, obj_t *argv);
+
 void setup_builtins(void);
 
+// Special forms and builtins are known to images by number.
+bool init_builtin(func_t *f, enum ftype type, size_t number);
+size_t builtin_number(func_t *f);
+uint64_t builtins_signature(void);
+
 
 
 #endif // BUILTINS_H
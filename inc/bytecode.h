@@ -0,0 +1,103 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "lisp.h"
+
+// The body of an interpreted function or macro that has been called
+//  more than once is compiled into code for a little stack machine
+//  whose stack is the value stack.  Each instruction is an opcode
+//  followed by its operands, which are indices into consts, argument
+//  counts, or absolute jump targets.
+enum opcode {
+  OP_CONST,		// k: push consts[k]
+  OP_VAR,		// k: push the value of the symbol consts[k]
+  OP_POP,
+  OP_JUMP,		// to: continue at code[to]
+  OP_JUMP_IF_NIL,	// to: pop, and jump if that was nil
+  OP_AND,		// to: jump if the top is nil, else pop it
+  OP_OR,		// to: jump if the top isn't nil, else pop it
+  OP_SET,		// k: set consts[k] to the popped value, push consts[k]
+  OP_DEF,		// k: likewise, but def it
+  OP_SPECIAL,		// f, k: push the special form consts[f] of consts[k]
+  OP_EVAL,		// k: push eval(consts[k]) the slow way
+  OP_CHECK_CALL,	// k, to: if the top is a special form or macro, call
+			//  it on the unevaluated cdr(consts[k]) and jump;
+			//  consts[k] is instead a lexical variable the form
+			//  uses if it can't be left to the interpreter
+  OP_CALL,		// n, k: call the function below n arguments, through
+			//  the symbol consts[k] or nil for the profiler
+  OP_TAIL_CALL,		// n, k: likewise, as the last thing before returning
+  OP_BUILTIN,		// f, n: call the builtin consts[f] on n arguments
+  OP_PROFILE,		// push whether this started the profiler
+  OP_END_PROFILE,	// pop a value, then stop the profiler if the top
+			//  says to, and replace the top with the value
+
+  // Lexical variables.  A boxed one is a cons whose car is its value,
+  //  so that it can be shared by closures and still be set.
+  OP_LOCAL,		// k: push local slot k
+  OP_SET_LOCAL,		// k: pop into local slot k
+  OP_ENV,		// k: push slot k of the closure's env
+  OP_BOX,		// k: put local slot k in a box
+  OP_UNBOX,
+  OP_SET_BOX,		// pop a value, and then the box to put it in
+  OP_CLOSURE,		// f, n: make a closure of consts[f] on the top n
+  OP_NAPPEND,		// for splicing in a quasiquote
+
+  // Builtins on two arguments, which only do anything special for
+  //  mints and otherwise just call through.
+  OP_ADD, OP_SUB, OP_MUL,
+  OP_LESS, OP_GREATER, OP_LESSEQ, OP_GREATEREQ, OP_EQUAL,
+
+  // One-argument builtins, and cons.
+  OP_CAR, OP_CDR, OP_NULLP, OP_CONS,
+
+  OP_RETURN,
+};
+
+typedef intptr_t code_t;
+
+// Everything the code refers to is in consts, which the collector
+//  traces and updates through the function that owns it.
+//  A lexical function has nlocals slots for its variables.
+typedef struct bytecode {
+  obj_t *consts;
+  size_t nconsts;
+  size_t nlocals;
+  size_t ncode;
+  code_t code[];
+} bytecode_t;
+
+// The code of a function whose body couldn't be compiled.  It keeps
+//  being interpreted.
+extern bytecode_t uncompilable;
+static inline bool has_bytecode(func_t *f) {
+  return f->code && f->code != &uncompilable;}
+
+// A closure shares the code of the function it was made from.
+static inline bool closurep(func_t *f) {
+  return f->lexical && vectorp(f->env);}
+static inline func_t *closure_template(func_t *f) {
+  return as_func(as_vector(f->env)->slots[0]);}
+
+// Calls before a function's body is compiled.
+#define COMPILE_THRESHOLD 2
+
+void compile_function(func_t *f);
+bool inlined_builtin(func_t *f);
+void free_bytecode(bytecode_t *code);
+bool ready_to_execute(func_t *f);
+obj_t execute(func_t *f, size_t frame, size_t bottom);
+
+// Calling conventions shared by the interpreter and the machine.  The
+//  next three consume the arguments from base up on the value stack,
+//  and a lexical function has to be just below them.
+obj_t call_lambda(func_t *f, obj_t args);
+obj_t call_builtin(func_t *f, size_t base);
+obj_t call_lambda_values(func_t *f, size_t base);
+void bind_values(func_t *f, size_t base, size_t frame);
+
+// Makes the arguments above stack into the first local slots of a
+//  lexical function, and fills the rest with nil.
+void enter_lexical(func_t *f, size_t stack);
+
+#endif // BYTECODE_H
@@ -10,29 +10,65 @@ typedef const char *key_t;
 
 hash_t hash(const char *str);
 
-
+// The same hash can be built up a character at a time, as the reader
+//  does while it scans a name: start from HASH_SEED, step through the
+//  characters and mix the result.
+#define HASH_SEED ((hash_t)5381)
+static inline hash_t hash_step(hash_t h, char c) {
+  return h*33 + (hash_t)c;}
+static inline hash_t hash_mix(hash_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  return h ^ h >> 33;}
+
+
+
+// A symbol holds its current value directly, whether that's a global
+//  or the innermost dynamic binding, and the flags say which.
+enum {
+  SYM_UNBOUND = 1,	// no value at all
+  SYM_CONSTANT = 2,	// def'd, or built in
+  SYM_MUTABLE = 4,	// a global that set made
+  SYM_SPECIAL = 8,	// dynamically bound right now
+};
 
 struct symtentry {
   hash_t hash;
   key_t key;
   obj_t val;
-
-  struct symtentry* next;
+  unsigned flags;
 };
 
+// An open-addressed table in the style of a Swiss table.  Slots come
+//  in groups of SYMT_GROUP_SIZE, and each has a control byte holding
+//  either the low seven bits of its entry's hash or a marker for an
+//  empty or deleted slot, so that a whole group can be checked for a
+//  key at once.  Entries never move, only the pointers to them.
+#define SYMT_GROUP_SIZE 16
+
 typedef struct symt {
+  size_t nslots;
   size_t nitems;
-  struct symtentry *table[0];
+  size_t ndeleted;
+  uint8_t *ctrl;
+  struct symtentry **slots;
 } symt_t;
 
 
 
-// Return a new symtable with the given number of slots.
-// We will return NULL if the number of slots isn't a power of two! 
-symt_t *symt_create(size_t nitems);
+// Return a new symtable with at least the given number of slots, which
+//  must be a power of two.  It grows as entries are added.
+symt_t *symt_create(size_t nslots);
+
+// Look up or add a key of the given length, which needn't be
+//  terminated, whose hash the caller has already computed.
+//  symt_add_hashed() must only be given a key that isn't present.
+//  Keys are copied when added, so the caller's buffer can be reused.
+sym_t *symt_find_hashed(symt_t*, key_t, size_t, hash_t);
+sym_t *symt_add_hashed(symt_t*, key_t, size_t, hash_t, obj_t);
 
-sym_t **symt_find_ll(symt_t*, key_t);
-sym_t *symt_add_at(sym_t**, key_t, obj_t);
+// Interns a name in the global symtable the same way (in lisp.c).
+sym_t *intern_hashed(key_t name, size_t len, hash_t h);
 
 // Return the entry of a key in a symtable.
 sym_t *symt_find(symt_t*, key_t);
@@ -0,0 +1,20 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+
+// An image is a snapshot of the whole heap, taken after loading, that
+//  a later run can start from instead of loading everything again.
+//  Pointers in it are indices, so it doesn't matter where anything
+//  ends up; the cons and function stores are mapped straight back in
+//  and fixed up where they lie.  Bytecode isn't kept, and is compiled
+//  again as functions get called.
+
+// Both return false, having said why on stderr, if they can't.  A
+//  dump collects first, and must be done at the top level.  A load
+//  must be the first thing to touch the heap, and makes the symbol
+//  table.
+bool dump_image(const char *path);
+bool load_image(const char *path);
+
+#endif // IMAGE_H
@@ -1,27 +1,44 @@
 #ifndef LISP_H
 #define LISP_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 enum type {
   TYPE_MINT=0,
   TYPE_CONS,
   TYPE_SYM,
   TYPE_FUNC,
+  TYPE_STRING,
+  TYPE_VECTOR,
+  TYPE_BIGNUM,
+  TYPE_TABLE,
 };
 
-// There are four basic datatypes; since I don't actually have any
-//  32-bit platforms to run on, this could be increased to eight,
-//  but I would need to choose at least three more first.
+// Every object is at least eight-byte aligned, since I don't actually
+//  have any 32-bit platforms to run on, which leaves three tag bits
+//  and room for eight datatypes.
 // CONS is the same as in any Lisp ever
-// MINT is a machine integer, a 30-bit (because of tags) fixnum.
+// MINT is a machine integer, a 61-bit (because of tags) fixnum.
 // SYM is a symbol type, pointing to a symtable entry.
 // FUNC points to the function object defined below.
+// STRING points to a packed, immutable string of bytes.
+// VECTOR points to a fixed-length array of objects.
+// BIGNUM points to an integer too big to be a mint.
+// TABLE points to a hash table.
+#define TAG_BITS 3
+#define TAG_MASK (((intptr_t)1 << TAG_BITS) - 1)
+
 typedef struct cons cons_t; 
 typedef intptr_t mint_t;
 typedef struct symtentry sym_t;
 typedef struct func func_t;
+typedef struct string string_t;
+typedef struct vector vector_t;
+typedef struct bignum bignum_t;
+typedef struct table table_t;
 
 typedef union obj {
   intptr_t tag;
@@ -30,6 +47,10 @@ typedef union obj {
   mint_t mint;
   sym_t *sym;
   func_t *func;
+  string_t *string;
+  vector_t *vector;
+  bignum_t *bignum;
+  table_t *table;
 } obj_t;
 
 typedef struct cons {
@@ -39,8 +60,9 @@ typedef struct cons {
 
 
 
-// There are four types of function-like objects, conveniently
-//  corresponding to the two available tag bits.
+// There are four types of function-like objects, kept in the low two
+//  bits of a func's funcptr, which are free since what it points to is
+//  aligned.
 // COMPILED is a regular compiled C function.
 // INTERP is an interpreted function, such as the return value of
 //   the (lambda) special form.
@@ -56,27 +78,132 @@ enum ftype {
 
 typedef union funcptr {
   intptr_t tag;
-  obj_t(*compiled)(obj_t);
+  obj_t(*compiled)(size_t, obj_t*);
+  obj_t(*special)(obj_t);
   cons_t *interp;
 } funcptr_t;
 
-// A func is a structure despite currently only containing
-//  one function pointer because TODO: add closures! :D
+// Interpreted functions and macros are compiled to bytecode once
+//  they have been called a few times; code is NULL until then.
+// Every function knows how many arguments it takes, with max_args
+//  ANY_ARGS if there's no limit.  An interpreted function's arity is
+//  read off its parameter list when it's made, and plain_params says
+//  whether that list is nothing but names.  A builtin may also have
+//  direct entry points for calls with exactly one or two arguments.
+// A lexical function, from lambda* or a lexical file, binds nothing
+//  dynamically: it's compiled before its first call, and its
+//  variables live in slots on the value stack.  Its env is a vector
+//  if it's a closure, holding the function it was made from and then
+//  the values it captured, or else a list of the names it captures,
+//  each one in a list of its own if it's boxed, so that it can be
+//  compiled again.  Only a lexical function has an env.
+#define ANY_ARGS UINT32_MAX
 typedef struct func {
   funcptr_t f;
+  struct bytecode *code;
+  size_t ncalls;
+  uint32_t min_args, max_args;
+  bool plain_params, lexical;
+  obj_t env;
+  obj_t (*fn1)(obj_t);
+  obj_t (*fn2)(obj_t, obj_t);
 } func_t;
 
+// Function objects are collected too.  alloc_func() may collect, so
+//  protect anything held across it.
+func_t *alloc_func(void);
+func_t *make_interp_func(enum ftype type, obj_t source, bool lexical);
+func_t *intern_func(enum ftype type, obj_t source, bool lexical);
+bool func_test_and_mark(func_t *func);
+void clear_func_marks(void);
+void sweep_funcs(void);
+bool func_marked(func_t *func);
+
+// Strings, vectors, bignums and tables are allocated one by one
+//  behind this header, and swept along with everything else.  They
+//  never move and are never young.  alloc_object() may collect, so
+//  protect anything held across it.  The header knows the type too,
+//  for images.
+typedef struct object {
+  size_t size;
+  bool marked;
+  uint8_t type;
+} object_t;
+void *alloc_object(enum type type, size_t bytes);
+void *copy_object(const object_t *obj);
+void sweep_objects(void);
+
+// A string holds no references.  The one alloc_string() returns has
+//  only its terminator filled in.
+typedef struct string {
+  object_t head;
+  size_t len;
+  char bytes[];
+} string_t;
+string_t *alloc_string(size_t len);
+obj_t string_from(const char *bytes, size_t len);
+
+// A vector starts out full of nil.  Anything stored into it later has
+//  to go through vector_set(), for the write barrier.  One asked for
+//  at run time can't be longer than MAX_VECTOR_LEN, so that a size
+//  out of reach is an error rather than the end of the process.
+#define MAX_VECTOR_LEN ((size_t)1 << 28)
+typedef struct vector {
+  object_t head;
+  size_t len;
+  obj_t slots[];
+} vector_t;
+vector_t *alloc_vector(size_t len);
+obj_t list_to_vector(obj_t list);
+
+// A bignum is sign and magnitude, the magnitude in 32-bit limbs with
+//  the least significant first and no leading zeros.  Arithmetic only
+//  makes one when the result doesn't fit in a mint, so every integer
+//  has exactly one representation.
+typedef uint32_t limb_t;
+typedef struct bignum {
+  object_t head;
+  bool negative;
+  size_t len;
+  limb_t limbs[];
+} bignum_t;
+
+// A hash table keys on identity, except that strings and bignums key
+//  on what they hold; a cons can't be a key, since it might move.
+//  The entries live in a vector, three words to each: a mint that
+//  says whether it's empty, deleted, or in use and with what hash,
+//  then the key and the value.  When the table grows, the entries in
+//  the old vector are moved across a few at a time by the operations
+//  that follow.  Its vectors are never young, so storing them needs
+//  no write barrier.
+typedef struct table {
+  object_t head;
+  size_t count, used;
+  obj_t entries, old;
+  size_t moved;
+} table_t;
+void move_entries(table_t *tab, size_t count);
+void rehash_table(table_t *tab);
+
+// Expansions of macro calls are cached by call site, weakly.
+obj_t expand_macro(func_t *macro, obj_t args);
+void forward_expansions(void);
+bool mark_expansions(void);
+void sweep_expansions(void);
+
 
 // Check the type of a func_t instance
 static inline enum ftype getftype(func_t *func) {
   return func->f.tag & 0x3;}
-static inline obj_t(*as_compiled(func_t *func))(obj_t) {
-  return (obj_t(*)(obj_t))((intptr_t)func->f.compiled & ~0x3);}
+static inline obj_t(*as_compiled(func_t *func))(size_t, obj_t*) {
+  return (obj_t(*)(size_t, obj_t*))((intptr_t)func->f.compiled & ~0x3);}
+static inline obj_t(*as_special(func_t *func))(obj_t) {
+  return (obj_t(*)(obj_t))((intptr_t)func->f.special & ~0x3);}
 static inline cons_t *as_interp(func_t *func) {
   return (cons_t*)((intptr_t)func->f.interp & ~0x3);}
 
 // Create the union part of a func_t instance.
-static inline funcptr_t make_compiled(obj_t(*comp)(obj_t)) {
+static inline funcptr_t make_compiled(obj_t(*comp)(size_t, obj_t*)) {
   return (funcptr_t)((intptr_t)comp | FTYPE_COMPILED);}
 static inline funcptr_t make_special(obj_t(*spec)(obj_t)) {
   return (funcptr_t)((intptr_t)spec | FTYPE_SPECIAL);}
@@ -87,7 +214,7 @@ static inline funcptr_t make_interp(cons_t *interp) {
 
 // Check the type of an obj_t instance
 static inline enum type gettype(obj_t obj) {
-  return obj.tag & 0x3;}
+  return obj.tag & TAG_MASK;}
 static inline bool consp(obj_t obj) {
   return gettype(obj) == TYPE_CONS;}
 static inline bool mintp(obj_t obj) {
@@ -96,26 +223,58 @@ static inline bool funcp(obj_t obj) {
   return gettype(obj) == TYPE_FUNC;}
 static inline bool symp(obj_t obj) {
   return gettype(obj) == TYPE_SYM;}
+static inline bool stringp(obj_t obj) {
+  return gettype(obj) == TYPE_STRING;}
+static inline bool vectorp(obj_t obj) {
+  return gettype(obj) == TYPE_VECTOR;}
+static inline bool bignump(obj_t obj) {
+  return gettype(obj) == TYPE_BIGNUM;}
+static inline bool tablep(obj_t obj) {
+  return gettype(obj) == TYPE_TABLE;}
+static inline bool integerp(obj_t obj) {
+  return mintp(obj) || bignump(obj);}
 
 // Cast an obj_t to the appropriate type.
 static inline cons_t *as_cons(obj_t obj) {
-  return (struct cons*)((intptr_t)obj.cons & ~0x3);}
+  return (struct cons*)((intptr_t)obj.cons & ~TAG_MASK);}
 static inline sym_t *as_sym(obj_t obj) {
-  return (sym_t*)((intptr_t)obj.sym & ~0x3);}
+  return (sym_t*)((intptr_t)obj.sym & ~TAG_MASK);}
 static inline func_t *as_func(obj_t obj) {
-  return (func_t*)((intptr_t)obj.func & ~0x3);}
+  return (func_t*)((intptr_t)obj.func & ~TAG_MASK);}
+static inline string_t *as_string(obj_t obj) {
+  return (string_t*)((intptr_t)obj.string & ~TAG_MASK);}
+static inline vector_t *as_vector(obj_t obj) {
+  return (vector_t*)((intptr_t)obj.vector & ~TAG_MASK);}
+static inline bignum_t *as_bignum(obj_t obj) {
+  return (bignum_t*)((intptr_t)obj.bignum & ~TAG_MASK);}
+static inline table_t *as_table(obj_t obj) {
+  return (table_t*)((intptr_t)obj.table & ~TAG_MASK);}
 static inline long as_mint(obj_t obj) {
-  return obj.mint >> 2;}
+  return obj.mint >> TAG_BITS;}
 
-// Cast one of the four datatypes to obj_t.
+// Cast one of the datatypes to obj_t.
 static inline obj_t make_cons(struct cons *cons) {
   return (obj_t)(((intptr_t)cons) | TYPE_CONS);}
 static inline obj_t make_sym(sym_t *sym) {
   return (obj_t)(((intptr_t)sym) | TYPE_SYM);}
 static inline obj_t make_func(func_t *func) {
   return (obj_t)(((intptr_t)func) | TYPE_FUNC);}
+static inline obj_t make_string(string_t *string) {
+  return (obj_t)(((intptr_t)string) | TYPE_STRING);}
+static inline obj_t make_vector(vector_t *vector) {
+  return (obj_t)(((intptr_t)vector) | TYPE_VECTOR);}
+static inline obj_t make_bignum(bignum_t *bignum) {
+  return (obj_t)(((intptr_t)bignum) | TYPE_BIGNUM);}
+static inline obj_t make_table(table_t *table) {
+  return (obj_t)(((intptr_t)table) | TYPE_TABLE);}
 static inline obj_t make_mint(long mint) {
-  return (obj_t)((mint << 2) | TYPE_MINT);}
+  return (obj_t)((mint << TAG_BITS) | TYPE_MINT);}
+
+// The range of a mint.  Tagged mints can be added and compared as
+//  they are, so __builtin_add_overflow() on two of them catches any
+//  sum that doesn't fit.
+#define MINT_MAX (INTPTR_MAX >> TAG_BITS)
+#define MINT_MIN (INTPTR_MIN >> TAG_BITS)
 
 // Predicates.
 extern obj_t nil;
@@ -130,11 +289,132 @@ obj_t cons(obj_t car, obj_t cdr);
 obj_t car(obj_t cons);
 obj_t cdr(obj_t cons);
 obj_t eval(obj_t);
+obj_t apply(obj_t fn, obj_t args);
+obj_t funcall(obj_t fn, obj_t form);
+
+
+// Conses only survive a collection if they can be reached from a
+//  symbol or from the root stack, and young conses move when they
+//  survive.  Arguments are the caller's job to keep alive, but any
+//  obj_t held in a local across something that might cons has to be
+//  protected first, and unprotected before returning.  cons()
+//  protects its own arguments.
+extern obj_t *root_stack[];
+extern size_t root_depth;
+size_t collect_garbage(void);
+
+// What the heap has been doing, for (gc-stats) and for the report
+//  that LISP_STATS asks for at exit.  None of it is counted in cons()
+//  itself: conses are counted a nursery at a time.  A pause is one
+//  stop for a collection of either kind, a full one included.
+typedef struct gc_stats {
+  size_t words_scanned;
+  size_t minor_collections, major_collections;
+  size_t cells_reclaimed;
+  size_t pauses;
+  uint64_t pause_ns, max_pause_ns, last_pause_ns;
+  size_t peak_store_used;
+  size_t funcs_made, syms_made;
+} gc_stats_t;
+extern gc_stats_t gc_stats;
+
+// The counters above and a few figures worked out from the heap,
+//  by name; fills in up to NGC_STATS and returns how many.
+typedef struct gc_stat {
+  const char *name;
+  uint64_t value;
+} gc_stat_t;
+#define NGC_STATS 14
+size_t read_gc_stats(gc_stat_t *stats);
+size_t conses_made(void);
+
+// What weak tables need from the collector.
+bool cons_marked(cons_t *cell);
+void mark_list(obj_t obj);
+void forward(obj_t *slot);
+static inline void protect(obj_t *root) {
+  root_stack[root_depth++] = root;}
+static inline void unprotect(size_t nroots) {
+  root_depth -= nroots;}
+
+// Each dynamic binding saves the value and flags it shadows here.
+//  The saved values are roots.
+typedef struct binding {
+  sym_t *sym;
+  obj_t saved;
+  unsigned saved_flags;
+} binding_t;
+extern binding_t binding_stack[];
+extern size_t binding_depth;
+
+// Every call to a function or builtin that hasn't returned yet, with
+//  the symbol its call site called it through, or nil, for the
+//  profiler to sample.  Only things that never move are kept here.
+//  A tail call replaces its caller's frame.
+typedef struct frame {
+  func_t *fn;
+  obj_t name;
+} frame_t;
+#define FRAME_STACK_SIZE ((size_t)1 << 20)
+extern frame_t frame_stack[];
+extern size_t frame_depth;
+
+// While (profile ...) runs, every frame is timed as well, in
+//  profile.c; otherwise this is all it costs.  start_tracing() returns
+//  false if it was already on, and stop_tracing() prints the report.
+extern bool tracing;
+bool start_tracing(void);
+void stop_tracing(void);
+void trace_enter(func_t *fn, obj_t name);
+void trace_exit(void);
+void trace_expansion(func_t *macro);
+
+static inline void push_frame(func_t *fn, obj_t name) {
+  frame_stack[frame_depth] = (frame_t){fn, name};
+  // A sample can be taken between any two instructions.
+  atomic_signal_fence(memory_order_release);
+  frame_depth++;
+  if (tracing) trace_enter(fn, name);}
+static inline void pop_frame(void) {
+  if (tracing) trace_exit();
+  frame_depth--;}
+static inline void replace_frame(func_t *fn, obj_t name) {
+  if (tracing) trace_exit();
+  frame_stack[frame_depth - 1] = (frame_t){fn, name};
+  if (tracing) trace_enter(fn, name);}
+
+// Evaluated arguments to builtins are pushed here rather than consed
+//  into a list.  Everything on it is a root.
+#define VALUE_STACK_SIZE ((size_t)1 << 20)
+extern obj_t value_stack[];
+extern size_t value_depth;
+static inline void push_value(obj_t val) {
+  value_stack[value_depth++] = val;}
+
+// Conses are born in the nursery.  Storing a pointer to one into
+//  anything that isn't has to go through write_barrier(), so that
+//  the next minor collection can find and update it.
+extern cons_t *nursery_start, *nursery_end;
+static inline bool youngp(obj_t obj) {
+  return consp(obj) && as_cons(obj) >= nursery_start
+    && as_cons(obj) < nursery_end;}
+void remember(obj_t container);
+static inline void write_barrier(obj_t container, obj_t val) {
+  if (youngp(val) && !youngp(container)) remember(container);}
+static inline void rplaca(obj_t cell, obj_t val) {
+  as_cons(cell)->car = val;
+  write_barrier(cell, val);}
+static inline void rplacd(obj_t cell, obj_t val) {
+  as_cons(cell)->cdr = val;
+  write_barrier(cell, val);}
+static inline void vector_set(vector_t *vec, size_t idx, obj_t val) {
+  vec->slots[idx] = val;
+  write_barrier(make_vector(vec), val);}
 
 
 // Manipulate the symbol table.
 sym_t *bind_sym(sym_t *sym, obj_t val);
-sym_t *unbind_sym(sym_t *sym);
+void unbind_to(size_t depth);
 sym_t *make_const(const char *name, obj_t val);
 obj_t name_value(const char *name);
 obj_t sym_value(sym_t *sym);
@@ -155,6 +435,7 @@ typedef enum {
   E_FAILED_BIND,
   E_INVALID_NAME,
   E_REDEFINE,
+  E_LEXICAL,
   E_RUNTIMEY,
 } error_t;
 
@@ -162,4 +443,8 @@ void error(error_t, obj_t);
 
 void die(void);
 
+void *reserve(size_t bytes);
+char *load_file(const char *path, size_t *size, bool *mapped);
+void unload_file(char *buf, size_t size, bool mapped);
+
 #endif // LISP_H
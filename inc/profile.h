@@ -0,0 +1,24 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+
+// A sampling profiler for Lisp code.  Every so often, in CPU time, a
+//  SIGPROF copies the frame stack into a ring of samples set aside in
+//  advance.  When it's stopped the samples are written out in the
+//  collapsed-stack format that flame graph tools read: one line per
+//  distinct stack, its frames outermost first and separated by
+//  semicolons, then a count.
+
+#define DEFAULT_PROFILE_INTERVAL_US 1000
+
+// Starts sampling, dropping any samples not yet written.  Returns
+//  false, having said why on stderr, if the timer can't be set.
+bool start_profile(long interval_us);
+
+// Stops sampling and writes out what was taken since it started or
+//  was last written, to path or else to stdout.  Returns the number
+//  of samples written, or -1 if the file can't be opened.
+long stop_profile(const char *path);
+
+#endif // PROFILE_H
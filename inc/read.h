@@ -0,0 +1,30 @@
+#ifndef READ_H
+#define READ_H
+
+#include <stdio.h>
+#include "lisp.h"
+
+// Forms are read out of a buffer: either a whole file, mapped into
+//  memory where possible, or a stream refilled a line at a time so
+//  that the prompt is answered as soon as a line is finished.  Tokens
+//  are taken straight out of the buffer as ranges of characters, and
+//  never span a refill since every line ends in whitespace.
+typedef struct reader {
+  const char *next;
+  const char *end;
+  char *buf;
+  size_t size;
+  FILE *in;		// where to refill from, or NULL for a whole file
+  bool mapped;
+  bool lexical;		// the first line says -*- lexical -*-
+} reader_t;
+
+// Returns NULL if the file can't be opened.  A file whose first line
+//  holds "-*- lexical -*-" has its forms evaluated with lexical scope.
+reader_t *open_reader(const char *path);
+reader_t *stream_reader(FILE *in);
+void close_reader(reader_t *r);
+
+obj_t read_form(reader_t *r);
+
+#endif // READ_H
@@ -0,0 +1,333 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "lisp.h"
+#include "bignum.h"
+
+// Products of operands with fewer limbs than this are done the
+//  schoolbook way; above it Karatsuba's three half-size products win.
+#define KARATSUBA_THRESHOLD 32
+
+#define LIMB_BITS 32
+
+// An integer of either kind seen as a sign and magnitude.  A mint's
+//  limbs are kept in the view itself.
+typedef struct intview {
+  bool negative;
+  size_t len;
+  const limb_t *limbs;
+  limb_t buf[2];
+} intview_t;
+
+void
+view_int(obj_t obj, intview_t *view) {
+  if (bignump(obj)) {
+    bignum_t *num = as_bignum(obj);
+    view->negative = num->negative;
+    view->len = num->len;
+    view->limbs = num->limbs;
+    return;
+  }
+
+  mint_t x = as_mint(obj);
+  uint64_t mag = x < 0? -(uint64_t)x : (uint64_t)x;
+  view->negative = x < 0;
+  view->buf[0] = (limb_t)mag;
+  view->buf[1] = (limb_t)(mag >> LIMB_BITS);
+  view->len = view->buf[1]? 2 : view->buf[0]? 1 : 0;
+  view->limbs = view->buf;
+}
+
+void *
+alloc_limbs(size_t len) {
+  limb_t *ret = malloc(sizeof(limb_t) * (len? len : 1));
+  if (!ret) die();
+  return ret;
+}
+
+// Makes the integer with the given sign and magnitude, which may have
+//  leading zeros.
+obj_t
+make_int(bool negative, const limb_t *limbs, size_t len) {
+  while (len && !limbs[len - 1]) len--;
+
+  if (len <= 2) {
+    uint64_t mag = len? limbs[0] : 0;
+    if (len == 2) mag |= (uint64_t)limbs[1] << LIMB_BITS;
+    if (!negative && mag <= (uint64_t)MINT_MAX)
+      return make_mint(mag);
+    if (negative && mag <= (uint64_t)MINT_MAX + 1)
+      return make_mint(-(mint_t)(mag - 1) - 1);
+  }
+
+  bignum_t *ret = alloc_object(TYPE_BIGNUM, sizeof(bignum_t) + sizeof(limb_t) * len);
+  ret->negative = negative;
+  ret->len = len;
+  memcpy(ret->limbs, limbs, sizeof(limb_t) * len);
+  return make_bignum(ret);
+}
+
+
+// Operations on magnitudes.
+
+int
+mag_compare(const limb_t *a, size_t alen, const limb_t *b, size_t blen) {
+  while (alen && !a[alen - 1]) alen--;
+  while (blen && !b[blen - 1]) blen--;
+  if (alen != blen) return alen < blen? -1 : 1;
+  while (alen--)
+    if (a[alen] != b[alen]) return a[alen] < b[alen]? -1 : 1;
+  return 0;
+}
+
+// Adds b into a, which has room for it, and returns the carry out of
+//  the top of a.
+limb_t
+mag_add_into(limb_t *a, size_t alen, const limb_t *b, size_t blen) {
+  uint64_t carry = 0;
+  size_t n = 0;
+  for (; n < blen; n++) {
+    carry += (uint64_t)a[n] + b[n];
+    a[n] = (limb_t)carry;
+    carry >>= LIMB_BITS;
+  }
+  for (; carry && n < alen; n++) {
+    carry += a[n];
+    a[n] = (limb_t)carry;
+    carry >>= LIMB_BITS;
+  }
+  return carry;
+}
+
+// Subtracts b from a, which mustn't be smaller.
+void
+mag_sub_into(limb_t *a, size_t alen, const limb_t *b, size_t blen) {
+  int64_t borrow = 0;
+  size_t n = 0;
+  for (; n < blen; n++) {
+    borrow += (int64_t)a[n] - b[n];
+    a[n] = (limb_t)borrow;
+    borrow >>= LIMB_BITS;
+  }
+  for (; borrow && n < alen; n++) {
+    borrow += a[n];
+    a[n] = (limb_t)borrow;
+    borrow >>= LIMB_BITS;
+  }
+}
+
+void
+mag_mul_schoolbook(const limb_t *a, size_t alen,
+		   const limb_t *b, size_t blen, limb_t *out) {
+  memset(out, 0, sizeof(limb_t) * (alen + blen));
+  for (size_t i = 0; i < alen; i++) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < blen; j++) {
+      carry += (uint64_t)a[i] * b[j] + out[i + j];
+      out[i + j] = (limb_t)carry;
+      carry >>= LIMB_BITS;
+    }
+    out[i + blen] = (limb_t)carry;
+  }
+}
+
+// Writes the alen + blen limbs of a * b into out, which mustn't
+//  overlap either.  Each operand is split in half at m limbs, and
+//  a*b = z2 B^2m + z1 B^m + z0 where z0 = a0 b0, z2 = a1 b1, and
+//  z1 = (a0 + a1)(b0 + b1) - z0 - z2.
+void
+mag_mul(const limb_t *a, size_t alen, const limb_t *b, size_t blen,
+	limb_t *out) {
+  if (alen < blen) {
+    const limb_t *tmp = a; a = b; b = tmp;
+    size_t len = alen; alen = blen; blen = len;
+  }
+  if (blen < KARATSUBA_THRESHOLD) {
+    mag_mul_schoolbook(a, alen, b, blen, out);
+    return;
+  }
+
+  size_t m = (alen + 1) / 2;
+
+  // Too lopsided to split b: multiply it by each half of a instead.
+  if (blen <= m) {
+    limb_t *high = alloc_limbs(alen - m + blen);
+    mag_mul(a, m, b, blen, out);
+    memset(&out[m + blen], 0, sizeof(limb_t) * (alen - m));
+    mag_mul(&a[m], alen - m, b, blen, high);
+    mag_add_into(&out[m], alen + blen - m, high, alen - m + blen);
+    free(high);
+    return;
+  }
+
+  size_t hlen = alen + blen - 2 * m;
+  mag_mul(a, m, b, m, out);
+  mag_mul(&a[m], alen - m, &b[m], blen - m, &out[2 * m]);
+
+  limb_t *sums = alloc_limbs(2 * (m + 1));
+  limb_t *asum = sums, *bsum = &sums[m + 1];
+  memcpy(asum, a, sizeof(limb_t) * m);
+  asum[m] = mag_add_into(asum, m, &a[m], alen - m);
+  memcpy(bsum, b, sizeof(limb_t) * m);
+  bsum[m] = mag_add_into(bsum, m, &b[m], blen - m);
+
+  limb_t *mid = alloc_limbs(2 * (m + 1));
+  mag_mul(asum, m + 1, bsum, m + 1, mid);
+  mag_sub_into(mid, 2 * (m + 1), out, 2 * m);
+  mag_sub_into(mid, 2 * (m + 1), &out[2 * m], hlen);
+
+  // The middle product can't carry past the top of the whole.
+  size_t midlen = 2 * (m + 1);
+  while (midlen && !mid[midlen - 1]) midlen--;
+  mag_add_into(&out[m], alen + blen - m, mid, midlen);
+  free(mid);
+  free(sums);
+}
+
+
+// Arithmetic.
+
+// Adds a and b, either of which may have its sign flipped.
+obj_t
+add_views(intview_t *a, intview_t *b) {
+  if (a->len < b->len) {
+    intview_t *tmp = a; a = b; b = tmp;
+  }
+  limb_t *sum = alloc_limbs(a->len + 1);
+  memcpy(sum, a->limbs, sizeof(limb_t) * a->len);
+  sum[a->len] = 0;
+
+  bool negative = a->negative;
+  if (a->negative == b->negative)
+    mag_add_into(sum, a->len + 1, b->limbs, b->len);
+  else if (mag_compare(a->limbs, a->len, b->limbs, b->len) >= 0)
+    mag_sub_into(sum, a->len, b->limbs, b->len);
+  else {
+    // |b| > |a| despite b being no longer, so they're the same length.
+    memcpy(sum, b->limbs, sizeof(limb_t) * b->len);
+    mag_sub_into(sum, b->len, a->limbs, a->len);
+    negative = b->negative;
+  }
+
+  obj_t ret = make_int(negative, sum, a->len + 1);
+  free(sum);
+  return ret;
+}
+
+obj_t
+int_add(obj_t a, obj_t b) {
+  intview_t x, y;
+  view_int(a, &x);
+  view_int(b, &y);
+  return add_views(&x, &y);
+}
+
+obj_t
+int_sub(obj_t a, obj_t b) {
+  intview_t x, y;
+  view_int(a, &x);
+  view_int(b, &y);
+  y.negative = !y.negative;
+  return add_views(&x, &y);
+}
+
+obj_t
+int_mul(obj_t a, obj_t b) {
+  intview_t x, y;
+  view_int(a, &x);
+  view_int(b, &y);
+  if (!x.len || !y.len) return make_mint(0);
+
+  limb_t *prod = alloc_limbs(x.len + y.len);
+  mag_mul(x.limbs, x.len, y.limbs, y.len, prod);
+  obj_t ret = make_int(x.negative != y.negative, prod, x.len + y.len);
+  free(prod);
+  return ret;
+}
+
+int
+int_compare(obj_t a, obj_t b) {
+  if (mintp(a) && mintp(b))
+    return (a.mint > b.mint) - (a.mint < b.mint);
+
+  intview_t x, y;
+  view_int(a, &x);
+  view_int(b, &y);
+  if (x.negative != y.negative)
+    return x.negative? -1 : 1;
+  int cmp = mag_compare(x.limbs, x.len, y.limbs, y.len);
+  return x.negative? -cmp : cmp;
+}
+
+
+obj_t
+parse_integer(const char *str) {
+  bool negative = *str == '-';
+  if (*str == '-' || *str == '+') str++;
+
+  unsigned base = 10;
+  if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X') && isxdigit(str[2])) {
+    base = 16;
+    str += 2;
+  } else if (str[0] == '0')
+    base = 8;
+  if (!*str) return nil;
+
+  size_t len = 0, capacity = 4;
+  limb_t *mag = alloc_limbs(capacity);
+  for (; *str; str++) {
+    unsigned digit = isdigit(*str)? *str - '0'
+      : isxdigit(*str)? tolower(*str) - 'a' + 10 : base;
+    if (digit >= base) {
+      free(mag);
+      return nil;
+    }
+
+    uint64_t carry = digit;
+    for (size_t n = 0; n < len; n++) {
+      carry += (uint64_t)mag[n] * base;
+      mag[n] = (limb_t)carry;
+      carry >>= LIMB_BITS;
+    }
+    if (carry) {
+      if (len == capacity) {
+	mag = realloc(mag, sizeof(limb_t) * (capacity *= 2));
+	if (!mag) die();
+      }
+      mag[len++] = (limb_t)carry;
+    }
+  }
+
+  obj_t ret = make_int(negative, mag, len);
+  free(mag);
+  return ret;
+}
+
+// Digits come off the bottom nine at a time, by dividing by 10^9.
+void
+print_bignum(bignum_t *num, FILE *out) {
+  limb_t *mag = alloc_limbs(num->len);
+  memcpy(mag, num->limbs, sizeof(limb_t) * num->len);
+  size_t len = num->len;
+
+  // Each limb gives fewer than ten decimal digits.
+  uint32_t *chunks = alloc_limbs(num->len * 10 / 9 + 2);
+  size_t nchunks = 0;
+  while (len) {
+    uint64_t rem = 0;
+    for (size_t n = len; n--;) {
+      rem = rem << LIMB_BITS | mag[n];
+      mag[n] = (limb_t)(rem / 1000000000);
+      rem %= 1000000000;
+    }
+    chunks[nchunks++] = (uint32_t)rem;
+    while (len && !mag[len - 1]) len--;
+  }
+
+  if (num->negative) putc('-', out);
+  fprintf(out, "%u", chunks[--nchunks]);
+  while (nchunks)
+    fprintf(out, "%09u", chunks[--nchunks]);
+  free(chunks);
+  free(mag);
+}
@@ -1,134 +1,272 @@
 #include "builtins.h"
 #include "hash.h"
+#include "bignum.h"
 #include <stdlib.h>
 
-void
-assert_argcount(obj_t args, size_t count) {
-  size_t counted = 0;
-  while (!nullp(args)) {
-    counted++;
-    args = cdr(args);
-  }
-  if (counted != count)
-    error(E_WRONG_ARGCOUNT, make_mint(counted));
+// An index below limit.
+size_t
+index_arg(obj_t obj, size_t limit) {
+  if (!mintp(obj) || as_mint(obj) < 0 || (size_t)as_mint(obj) >= limit)
+    error(E_INVALID_ARG, obj);
+  return as_mint(obj);
 }
 
+// Builds a fresh list out of an argument vector.
 obj_t
-create_builtin(const char *name, builtin_t *func) {
-  func_t *funobj = malloc(sizeof(func_t));
-  *funobj = (func_t){make_compiled(func)};
-  return make_sym(make_const(name, make_func(funobj)));
+list_from_args(size_t argc, obj_t *argv) {
+  obj_t ret = nil;
+  protect(&ret);
+  while (argc--)
+    ret = cons(argv[argc], ret);
+  unprotect(1);
+  return ret;
 }
 
-obj_t
-create_special_form(const char *name, builtin_t *func) {
-  func_t *funobj = malloc(sizeof(func_t));
-  *funobj = (func_t){make_special(func)};
-  return make_sym(make_const(name, make_func(funobj)));
+// Every special form and builtin, numbered by its place here, which
+//  is how an image refers to them.  Adding, removing or reordering any
+//  of them makes old images unusable.
+const struct {
+  const char *name;
+  special_t *fn;
+} special_forms[] = {
+  {"cond", &op_cond},
+  {"quote", &op_quote},
+  {"quasiquote", &op_quasiquote},
+  {"lambda", &op_lambda},
+  {"mu", &op_mu},
+  {"set", &op_set},
+  {"def", &op_def},
+  {"do", &op_do},
+  {"and", &op_and},
+  {"or", &op_or},
+  {"profile", &op_profile},
+  {"lambda*", &op_lambda_star},
+};
+
+const struct {
+  const char *name;
+  builtin_t *fn;
+  uint32_t min_args, max_args;
+  builtin1_t *fn1;
+  builtin2_t *fn2;
+} builtins[] = {
+  {"!=", &fn_notequal, 0, ANY_ARGS, NULL, &fn2_notequal},
+  {"=", &fn_equal, 0, ANY_ARGS, NULL, &fn2_equal},
+  {"<", &fn_less, 0, ANY_ARGS, NULL, &fn2_less},
+  {">", &fn_greater, 0, ANY_ARGS, NULL, &fn2_greater},
+  {"<=", &fn_lesseq, 0, ANY_ARGS, NULL, &fn2_lesseq},
+  {">=", &fn_greatereq, 0, ANY_ARGS, NULL, &fn2_greatereq},
+  {"cons?", &fn_consp, 1, 1, &fn1_consp, NULL},
+  {"sym?", &fn_symp, 1, 1, &fn1_symp, NULL},
+  {"mint?", &fn_mintp, 1, 1, &fn1_mintp, NULL},
+  {"integer?", &fn_integerp, 1, 1, &fn1_integerp, NULL},
+  {"fun?", &fn_funp, 1, 1, &fn1_funp, NULL},
+  {"null?", &fn_nullp, 1, 1, &fn1_nullp, NULL},
+
+  {"+", &fn_add, 0, ANY_ARGS, NULL, &fn2_add},
+  {"-", &fn_sub, 0, ANY_ARGS, NULL, &fn2_sub},
+  {"*", &fn_mul, 0, ANY_ARGS, NULL, &fn2_mul},
+  {"%", &fn_mod, 2, 2, NULL, &fn2_mod},
+
+  {"list", &fn_list, 0, ANY_ARGS, NULL, NULL},
+  {"cons", &fn_cons, 2, 2, NULL, &cons},
+  {"car", &fn_car, 1, 1, &car, NULL},
+  {"cdr", &fn_cdr, 1, 1, &cdr, NULL},
+  {"rplaca", &fn_rplaca, 2, 2, NULL, &fn2_rplaca},
+  {"rplacd", &fn_rplacd, 2, 2, NULL, &fn2_rplacd},
+
+  {"string?", &fn_stringp, 1, 1, NULL, NULL},
+  {"string-length", &fn_string_length, 1, 1, &fn1_string_length, NULL},
+  {"string-ref", &fn_string_ref, 2, 2, NULL, &fn2_string_ref},
+  {"substring", &fn_substring, 2, 3, NULL, NULL},
+  {"string-append", &fn_string_append, 0, ANY_ARGS, NULL, NULL},
+  {"string=", &fn_string_equal, 0, ANY_ARGS, NULL, NULL},
+  {"string->list", &fn_string_to_list, 1, 1, NULL, NULL},
+  {"list->string", &fn_list_to_string, 1, 1, NULL, NULL},
+  {"is-lower", &fn_is_lower, 1, 1, NULL, NULL},
+  {"is-upper", &fn_is_upper, 1, 1, NULL, NULL},
+  {"is-digit", &fn_is_digit, 1, 1, NULL, NULL},
+  {"to-upper", &fn_to_upper, 1, 1, NULL, NULL},
+  {"to-lower", &fn_to_lower, 1, 1, NULL, NULL},
+
+  {"vector?", &fn_vectorp, 1, 1, NULL, NULL},
+  {"vector", &fn_vector, 0, ANY_ARGS, NULL, NULL},
+  {"make-vector", &fn_make_vector, 1, 2, NULL, NULL},
+  {"vector-length", &fn_vector_length, 1, 1, &fn1_vector_length, NULL},
+  {"vector-ref", &fn_vector_ref, 2, 2, NULL, &fn2_vector_ref},
+  {"vector-set!", &fn_vector_set, 3, 3, NULL, NULL},
+  {"vector->list", &fn_vector_to_list, 1, 1, NULL, NULL},
+  {"list->vector", &fn_list_to_vector, 1, 1, NULL, NULL},
+
+  {"hash?", &fn_tablep, 1, 1, NULL, NULL},
+  {"make-hash", &fn_make_hash, 0, 1, NULL, NULL},
+  {"hash-get", &fn_hash_get, 2, 3, NULL, NULL},
+  {"hash-put!", &fn_hash_put, 3, 3, NULL, NULL},
+  {"hash-remove!", &fn_hash_remove, 2, 2, NULL, NULL},
+  {"hash-count", &fn_hash_count, 1, 1, NULL, NULL},
+  {"hash-keys", &fn_hash_keys, 1, 1, NULL, NULL},
+  {"hash->list", &fn_hash_to_list, 1, 1, NULL, NULL},
+
+  {"err", &fn_error, 0, ANY_ARGS, NULL, NULL},
+  {"print", &fn_print, 0, ANY_ARGS, NULL, NULL},
+  {"printnl", &fn_printnl, 0, ANY_ARGS, NULL, NULL},
+  {"eval", &fn_eval, 0, ANY_ARGS, NULL, NULL},
+  {"apply", &fn_apply, 2, 2, NULL, NULL},
+  {"gc", &fn_gc, 0, 0, NULL, NULL},
+  {"gc-stats", &fn_gc_stats, 0, 0, NULL, NULL},
+  {"profile-start", &fn_profile_start, 0, 1, NULL, NULL},
+  {"profile-stop", &fn_profile_stop, 0, 1, NULL, NULL},
+};
+
+#define NSPECIAL_FORMS (sizeof(special_forms) / sizeof(*special_forms))
+#define NBUILTINS (sizeof(builtins) / sizeof(*builtins))
+
+// Fills in a function object as the special form or builtin with the
+//  given number, returning false if there's no such thing.
+bool
+init_builtin(func_t *f, enum ftype type, size_t number) {
+  if (type == FTYPE_SPECIAL && number < NSPECIAL_FORMS)
+    *f = (func_t){make_special(special_forms[number].fn),
+      .max_args = ANY_ARGS};
+  else if (type == FTYPE_COMPILED && number < NBUILTINS)
+    *f = (func_t){make_compiled(builtins[number].fn),
+      .min_args = builtins[number].min_args,
+      .max_args = builtins[number].max_args,
+      .fn1 = builtins[number].fn1, .fn2 = builtins[number].fn2};
+  else return false;
+  return true;
+}
+
+// The number of a special form or builtin.
+size_t
+builtin_number(func_t *f) {
+  size_t n = 0;
+  if (getftype(f) == FTYPE_SPECIAL)
+    while (special_forms[n].fn != as_special(f)) n++;
+  else
+    while (builtins[n].fn != as_compiled(f)) n++;
+  return n;
+}
+
+// A hash of every name in the tables, which an image keeps so that
+//  one made by a build with different builtins can be refused.
+hash_t
+builtins_signature() {
+  hash_t h = HASH_SEED;
+  for (size_t n = 0; n < NSPECIAL_FORMS + NBUILTINS; n++) {
+    const char *name = n < NSPECIAL_FORMS? special_forms[n].name
+      : builtins[n - NSPECIAL_FORMS].name;
+    while (*name)
+      h = hash_step(h, *name++);
+    h = hash_step(h, n < NSPECIAL_FORMS? '|' : ' ');
+  }
+  return hash_mix(h);
 }
 
 void
 setup_builtins() {
-  create_special_form("cond", &op_cond);
-  create_special_form("quote", &op_quote);
-  create_special_form("quasiquote", &op_quasiquote);
-  create_special_form("lambda", &op_lambda);
-  create_special_form("mu", &op_mu);
-  create_special_form("set", &op_set);
-  create_special_form("def", &op_def);
-  create_special_form("do", &op_do);
-  create_special_form("and", &op_and);
-  create_special_form("or", &op_or);
-
-  create_builtin("!=", &fn_notequal);
-  create_builtin("=", &fn_equal);
-  create_builtin("<", &fn_less);
-  create_builtin(">", &fn_greater);
-  create_builtin("<=", &fn_lesseq);
-  create_builtin(">=", &fn_greatereq);
-  create_builtin("cons?", &fn_consp);
-  create_builtin("sym?", &fn_symp);
-  create_builtin("mint?", &fn_mintp);
-  create_builtin("fun?", &fn_funp);
-  create_builtin("null?", fn_nullp);
-
-  create_builtin("+", &fn_add);
-  create_builtin("-", &fn_sub);
-  create_builtin("*", &fn_mul);
-  create_builtin("%", &fn_mod);
-
-  create_builtin("list", &fn_list);
-  create_builtin("cons", &fn_cons);
-  create_builtin("car", &fn_car);
-  create_builtin("cdr", &fn_cdr);
-
-  create_builtin("err", &fn_error);
-  create_builtin("print", &fn_print);
-  create_builtin("printnl", &fn_printnl);
-  create_builtin("eval", &fn_eval);
+  for (size_t n = 0; n < NSPECIAL_FORMS; n++) {
+    func_t *f = alloc_func();
+    init_builtin(f, FTYPE_SPECIAL, n);
+    make_const(special_forms[n].name, make_func(f));
+  }
+  for (size_t n = 0; n < NBUILTINS; n++) {
+    func_t *f = alloc_func();
+    init_builtin(f, FTYPE_COMPILED, n);
+    make_const(builtins[n].name, make_func(f));
+  }
 }
 
 obj_t
 op_cond(obj_t args) {
   obj_t cond;
+  protect(&args);
   while (!nullp(cond = car(args))) {
-    if (!nullp(eval(cond)))
+    if (!nullp(eval(cond))) {
+      unprotect(1);
       return eval(car(cdr(args)));
+    }
     args = cdr(cdr(args));
   }
+  unprotect(1);
   return nil;
 }
 
 obj_t
 op_and(obj_t args) {
   obj_t ret = t;
+  protect(&args);
   while (!nullp(args)) {
     if (nullp(ret = eval(car(args))))
-      return nil;
+      break;
     args = cdr(args);
   }
+  unprotect(1);
   return ret;
 }
 
 obj_t 
 op_or(obj_t args) {
   obj_t ret = nil;
+  protect(&args);
   while (!nullp(args)) {
     if (!nullp(ret = eval(car(args))))
-      return ret;
+      break;
     args = cdr(args);
   }
-  return nil;
+  unprotect(1);
+  return ret;
 }
 
 obj_t
-fn_eval(obj_t args) {
+fn_eval(size_t argc, obj_t *argv) {
   obj_t ret = nil;
-  while (consp(args)) {
-    ret = eval(car(args));
-    args = cdr(args);
-  }
+  for (size_t n = 0; n < argc; n++)
+    ret = eval(argv[n]);
   return ret;
 }
 
+obj_t
+fn_apply(size_t argc, obj_t *argv) {
+  return apply(argv[0], argv[1]);
+}
+
 
 void printy(obj_t);
 int putchar(int);
 obj_t
-fn_print(obj_t args) {
+fn_print(size_t argc, obj_t *argv) {
   obj_t ret = nil;
-  while (consp(args)) {
-    printy(ret = car(args));
+  for (size_t n = 0; n < argc; n++) {
+    printy(ret = argv[n]);
     putchar(' ');
-    args = cdr(args);
   }
-  if (!nullp(args)) printy(args);
   return ret;
 }
 
 obj_t
-fn_printnl(obj_t args) {
-  obj_t ret = fn_print(args);
+fn_gc(size_t argc, obj_t *argv) {
+  return make_mint(collect_garbage());
+}
+
+// An alist of the heap's statistics, as read_gc_stats() names them.
+obj_t
+fn_gc_stats(size_t argc, obj_t *argv) {
+  gc_stat_t stats[NGC_STATS];
+  size_t nstats = read_gc_stats(stats);
+  obj_t ret = nil;
+  protect(&ret);
+  while (nstats--) {
+    obj_t name = make_sym(intern_name(stats[nstats].name));
+    ret = cons(cons(name, make_mint(stats[nstats].value)), ret);
+  }
+  unprotect(1);
+  return ret;
+}
+
+obj_t
+fn_printnl(size_t argc, obj_t *argv) {
+  obj_t ret = fn_print(argc, argv);
   putchar('\n');
   return ret;
 }
@@ -137,20 +275,20 @@ fn_printnl(obj_t args) {
 obj_t
 op_do(obj_t args) {
   obj_t ret = nil;
+  protect(&args);
   while (consp(args)) {
     ret = eval(car(args));
     args = cdr(args);
   }
+  unprotect(1);
   return ret;
 }
 
-obj_t eval_list(obj_t);
-
 obj_t
 nappend(obj_t a, obj_t b) {
   if (consp(a) && !nullp(b)) {
     if (nullp(cdr(a)))
-      as_cons(a)->cdr = b;
+      rplacd(a, b);
     else nappend(cdr(a), b);
   }
   return a;
@@ -163,16 +301,24 @@ op_quasiquote(obj_t args) {
   if (eqp(car(args), unquote))
     return eval(cdr(args));
 
+  protect(&args);
+  obj_t head = op_quasiquote(car(args));
+  protect(&head);
+
+  obj_t tail;
   if (eqp(car(car(cdr(args))), unquote_splice)) {
-    return cons(op_quasiquote(car(args)),
-		nappend(eval(cdr(car(cdr(args)))),
-			op_quasiquote(cdr(cdr(args)))));
+    obj_t spliced = eval(cdr(car(cdr(args))));
+    protect(&spliced);
+    obj_t rest = op_quasiquote(cdr(cdr(args)));
+    tail = nappend(spliced, rest);
+    unprotect(1);
+  } else {
+    tail = op_quasiquote(cdr(args));
   }
-		
-		
 
-  return cons(op_quasiquote(car(args)),
-	      op_quasiquote(cdr(args)));
+  obj_t ret = cons(head, tail);
+  unprotect(2);
+  return ret;
 }
 
 obj_t
@@ -182,123 +328,148 @@ op_quote(obj_t args) {
 
 obj_t
 op_mu(obj_t args) {
-  func_t *fun = malloc(sizeof(func_t));
-  fun->f = make_macro(as_cons(args));
-  return make_func(fun);
+  return make_func(intern_func(FTYPE_MACRO, args, false));
 }
 
 obj_t
-fn_error(obj_t args) {
-  error(E_RUNTIMEY, args);
+fn_error(size_t argc, obj_t *argv) {
+  error(E_RUNTIMEY, list_from_args(argc, argv));
   // unreachable
   return nil;
 }
 
 obj_t
 op_lambda(obj_t args) {
-  func_t *fun = malloc(sizeof(func_t));
-  fun->f = make_interp(as_cons(args));
-  return make_func(fun);
+  return make_func(intern_func(FTYPE_INTERP, args, false));
 }
 
+// A lambda* evaluated here, rather than compiled inside another
+//  lexical function, has no lexical variables around it to capture.
 obj_t
-fn_greatereq(obj_t args) {
-  if (nullp(args)) return t;
+op_lambda_star(obj_t args) {
+  return make_func(intern_func(FTYPE_INTERP, args, true));
+}
 
-  obj_t item = car(args);
-  if (!mintp(item))
-    error(E_INVALID_ARG, item);
+void
+check_integers(size_t argc, obj_t *argv) {
+  for (size_t n = 0; n < argc; n++)
+    if (!integerp(argv[n]))
+      error(E_INVALID_ARG, argv[n]);
+}
 
-  while (!nullp(args = cdr(args))) {
-    if (!mintp(car(args)))
-      error(E_INVALID_ARG, item);
-    if (!(as_mint(item) >= as_mint(car(args))))
-      return nil;
-    item = car(args);
-  }
-  return t;
+// Compares two integers of either kind.
+int
+compare_args(obj_t a, obj_t b) {
+  if (mintp(a) && mintp(b))
+    return (a.mint > b.mint) - (a.mint < b.mint);
+  if (!integerp(a))
+    error(E_INVALID_ARG, a);
+  if (!integerp(b))
+    error(E_INVALID_ARG, b);
+  return int_compare(a, b);
 }
 
 obj_t
-fn_lesseq(obj_t args) {
-  if (nullp(args)) return t;
+fn2_greatereq(obj_t a, obj_t b) {
+  return compare_args(a, b) >= 0? t : nil;
+}
 
-  obj_t item = car(args);
-  if (!mintp(item))
-    error(E_INVALID_ARG, item);
+obj_t
+fn2_lesseq(obj_t a, obj_t b) {
+  return compare_args(a, b) <= 0? t : nil;
+}
 
-  while (!nullp(args = cdr(args))) {
-    if (!mintp(car(args)))
-      error(E_INVALID_ARG, item);
-    if (!(as_mint(item) <= as_mint(car(args))))
-      return nil;
-    item = car(args);
-  }
-  return t;
+obj_t
+fn2_greater(obj_t a, obj_t b) {
+  return compare_args(a, b) > 0? t : nil;
+}
+
+obj_t
+fn2_less(obj_t a, obj_t b) {
+  return compare_args(a, b) < 0? t : nil;
 }
 
 obj_t
-fn_greater(obj_t args) {
-  if (nullp(args)) return t;
+fn2_equal(obj_t a, obj_t b) {
+  return eqp(a, b) || (bignump(a) && bignump(b) && !int_compare(a, b))?
+    t : nil;
+}
 
-  obj_t item = car(args);
-  if (!mintp(item))
-    error(E_INVALID_ARG, item);
+obj_t
+fn2_notequal(obj_t a, obj_t b) {
+  return nullp(fn2_equal(a, b))? t : nil;
+}
 
-  while (!nullp(args = cdr(args))) {
-    if (!mintp(car(args)))
-      error(E_INVALID_ARG, item);
-    if (!(as_mint(item) > as_mint(car(args))))
+obj_t
+fn_greatereq(size_t argc, obj_t *argv) {
+  check_integers(argc, argv);
+  for (size_t n = 1; n < argc; n++)
+    if (!(int_compare(argv[n-1], argv[n]) >= 0))
       return nil;
-    item = car(args);
-  }
   return t;
 }
 
 obj_t
-fn_less(obj_t args) {
-  if (nullp(args)) return t;
+fn_lesseq(size_t argc, obj_t *argv) {
+  check_integers(argc, argv);
+  for (size_t n = 1; n < argc; n++)
+    if (!(int_compare(argv[n-1], argv[n]) <= 0))
+      return nil;
+  return t;
+}
 
-  obj_t item = car(args);
-  if (!mintp(item))
-    error(E_INVALID_ARG, item);
+obj_t
+fn_greater(size_t argc, obj_t *argv) {
+  check_integers(argc, argv);
+  for (size_t n = 1; n < argc; n++)
+    if (!(int_compare(argv[n-1], argv[n]) > 0))
+      return nil;
+  return t;
+}
 
-  while (!nullp(args = cdr(args))) {
-    if (!mintp(car(args)))
-      error(E_INVALID_ARG, item);
-    if (!(as_mint(item) < as_mint(car(args))))
+obj_t
+fn_less(size_t argc, obj_t *argv) {
+  check_integers(argc, argv);
+  for (size_t n = 1; n < argc; n++)
+    if (!(int_compare(argv[n-1], argv[n]) < 0))
       return nil;
-    item = car(args);
-  }
   return t;
 }
 
 obj_t
-fn_notequal(obj_t args) {
-  return nullp(fn_equal(args))? t : nil;
+fn_notequal(size_t argc, obj_t *argv) {
+  return nullp(fn_equal(argc, argv))? t : nil;
 }
 
 obj_t
-fn_equal(obj_t args) {
-  obj_t item = car(args);
-  while (!nullp(args = cdr(args))) {
-    if (!eqp(car(args), item))
+fn_equal(size_t argc, obj_t *argv) {
+  for (size_t n = 1; n < argc; n++)
+    if (nullp(fn2_equal(argv[n], argv[0])))
       return nil;
-  }
   return t;
 }
 
-// defines a constant
-obj_t
-op_def(obj_t args) {
-  // must have an even number of arguments
-  if (!listp(args)) return args;
-  if (!listp(cdr(args)))
-    error(E_FAILED_BIND, cons(cons(car(args), nil), cdr(args)));
-  
-  obj_t name = car(args);
-  obj_t val = eval(car(cdr(args)));
+// Gives an unbound variable a constant value.
+void
+def_sym(obj_t name, obj_t val) {
+  if (!symp(name))
+    error(E_INVALID_NAME, name);
+  if (nullp(name))
+    error(E_REDEFINE, name);
+
+  sym_t *sym = as_sym(name);
 
+  if (sym->flags != SYM_UNBOUND)
+    error(E_REDEFINE, name);
+  sym->val = val;
+  sym->flags = SYM_CONSTANT;
+  write_barrier(name, val);
+}
+
+// Changes the innermost binding of a variable, making it a mutable
+//  global if it has none.  Constants can't be set.
+void
+set_sym(obj_t name, obj_t val) {
   if (!symp(name))
     error(E_INVALID_NAME, name);
   if (nullp(name))
@@ -306,10 +477,30 @@ op_def(obj_t args) {
 
   sym_t *sym = as_sym(name);
 
-  if (!nullp(sym->val))
+  if (sym->flags & SYM_CONSTANT)
     error(E_REDEFINE, name);
-  else
-    sym->val = val;
+  sym->val = val;
+  if (!(sym->flags & SYM_SPECIAL))
+    sym->flags = SYM_MUTABLE;
+  write_barrier(name, val);
+}
+
+// defines a constant
+obj_t
+op_def(obj_t args) {
+  // must have an even number of arguments
+  if (!listp(args)) return args;
+  if (!listp(cdr(args))) {
+    obj_t name = cons(car(args), nil);
+    error(E_FAILED_BIND, cons(name, cdr(args)));
+  }
+  
+  protect(&args);
+  obj_t name = car(args);
+  obj_t val = eval(car(cdr(args)));
+  unprotect(1);
+
+  def_sym(name, val);
 
   if (nullp(cdr(cdr(args)))) return name;
   else return op_def(cdr(cdr(args)));
@@ -320,90 +511,129 @@ obj_t
 op_set(obj_t args) {
   // must have an even number of arguments
   if (!listp(args)) return nil;
-  if (!listp(cdr(args)))
-    error(E_FAILED_BIND, cons(cons(car(args), nil), cdr(args)));
+  if (!listp(cdr(args))) {
+    obj_t name = cons(car(args), nil);
+    error(E_FAILED_BIND, cons(name, cdr(args)));
+  }
   
+  protect(&args);
   obj_t name = car(args);
   obj_t val = eval(car(cdr(args)));
+  set_sym(name, val);
+  unprotect(1);
 
-  if (!symp(name))
-    error(E_INVALID_NAME, name);
-  if (nullp(name))
-    error(E_REDEFINE, name);
+  if (nullp(cdr(cdr(args)))) return name;
+  else return op_set(cdr(cdr(args)));
+}
 
-  sym_t *sym = as_sym(name);
+// Two mints are added, subtracted or multiplied with their tags on,
+//  which are zero, so the overflow checks match the range of a mint.
+obj_t
+fn2_add(obj_t a, obj_t b) {
+  mint_t r;
+  if (mintp(a) && mintp(b) && !__builtin_add_overflow(a.mint, b.mint, &r))
+    return (obj_t)r;
+  check_integers(2, (obj_t[]){a, b});
+  return int_add(a, b);
+}
 
-  if (nullp(sym->val))
-    sym->val = cons(val, nil);
-  else if (consp(sym->val))
-    as_cons(sym->val)->car = val;
-  else
-    error(E_REDEFINE, name);
+obj_t
+fn2_sub(obj_t a, obj_t b) {
+  mint_t r;
+  if (mintp(a) && mintp(b) && !__builtin_sub_overflow(a.mint, b.mint, &r))
+    return (obj_t)r;
+  check_integers(2, (obj_t[]){a, b});
+  return int_sub(a, b);
+}
 
-  if (nullp(cdr(cdr(args)))) return name;
-  else return op_set(cdr(cdr(args)));
+obj_t
+fn2_mul(obj_t a, obj_t b) {
+  mint_t r;
+  if (mintp(a) && mintp(b)
+      && !__builtin_mul_overflow(as_mint(a), b.mint, &r))
+    return (obj_t)r;
+  check_integers(2, (obj_t[]){a, b});
+  return int_mul(a, b);
 }
 
+// Sums and products are kept tagged while they fit in a mint, and
+//  carried on as integers of either kind from the first argument that
+//  isn't a mint or would overflow.
 obj_t
-fn_add(obj_t args) {
-  mint_t sum = 0;
-  while (!nullp(args)) {
-    if (!mintp(car(args)))
-      error(E_INVALID_ARG, car(args));
-    sum += as_mint(car(args));
-    args = cdr(args);
+fn_add(size_t argc, obj_t *argv) {
+  obj_t sum = make_mint(0);
+  size_t n = 0;
+  for (mint_t next; n < argc; n++) {
+    if (!mintp(argv[n])
+	|| __builtin_add_overflow(sum.mint, argv[n].mint, &next))
+      break;
+    sum.mint = next;
   }
-  return make_mint(sum);
+  if (n == argc) return sum;
+
+  check_integers(argc, argv);
+  protect(&sum);
+  for (; n < argc; n++)
+    sum = int_add(sum, argv[n]);
+  unprotect(1);
+  return sum;
 }
 
 obj_t
-fn_sub(obj_t args) {
-  if (nullp(args)) return make_mint(0);
-  if (!mintp(car(args)))
-    error(E_INVALID_ARG, car(args));
+fn_sub(size_t argc, obj_t *argv) {
+  if (argc == 0) return make_mint(0);
+  check_integers(argc, argv);
 
-  if (nullp(cdr(args)))
-    return make_mint(-as_mint(car(args)));
+  // A single argument is negated.
+  obj_t diff = argc == 1? make_mint(0) : argv[0];
+  size_t n = argc == 1? 0 : 1;
+  for (mint_t next; n < argc; n++) {
+    if (!mintp(diff) || !mintp(argv[n])
+	|| __builtin_sub_overflow(diff.mint, argv[n].mint, &next))
+      break;
+    diff.mint = next;
+  }
 
-  mint_t sum = as_mint(car(args));
-  do {
-    args = cdr(args);
-    if (!mintp(car(args)))
-      error(E_INVALID_ARG, car(args));
-    sum -= as_mint(car(args));
-  } while(!nullp(cdr(args)));
-  return make_mint(sum);
+  protect(&diff);
+  for (; n < argc; n++)
+    diff = int_sub(diff, argv[n]);
+  unprotect(1);
+  return diff;
 }
 
 obj_t
-fn_mul(obj_t args) {
-  mint_t prod = 1;
-  while (!nullp(args)) {
-    if (!mintp(car(args)))
-      error(E_INVALID_ARG, car(args));
-    prod *= as_mint(car(args));
-    args = cdr(args);
+fn_mul(size_t argc, obj_t *argv) {
+  obj_t prod = make_mint(1);
+  size_t n = 0;
+  for (mint_t next; n < argc; n++) {
+    if (!mintp(argv[n])
+	|| __builtin_mul_overflow(as_mint(prod), argv[n].mint, &next))
+      break;
+    prod.mint = next;
   }
-  return make_mint(prod);
+  if (n == argc) return prod;
+
+  check_integers(argc, argv);
+  protect(&prod);
+  for (; n < argc; n++)
+    prod = int_mul(prod, argv[n]);
+  unprotect(1);
+  return prod;
 }
 
 obj_t
-fn_div(obj_t args) {
+fn_div(size_t argc, obj_t *argv) {
   mint_t prod = 1;
-  while (!nullp(args)) {
-    if (!mintp(car(args))) 
-      error(E_INVALID_ARG, car(args));
-    prod /= as_mint(car(args));
-    args = cdr(args);
+  for (size_t n = 0; n < argc; n++) {
+    if (!mintp(argv[n])) 
+      error(E_INVALID_ARG, argv[n]);
+    prod /= as_mint(argv[n]);
   }
   return make_mint(prod);
 }
 
 obj_t
-fn_mod(obj_t args) {
-  assert_argcount(args, 2);
-  obj_t n = car(args);
-  obj_t p = car(cdr(args));
+fn2_mod(obj_t n, obj_t p) {
   if (!mintp(n))
     error(E_INVALID_ARG, n);
   if (!mintp(p))
@@ -412,61 +642,112 @@ fn_mod(obj_t args) {
 }
 
 obj_t
-fn_car(obj_t args) {
-  assert_argcount(args, 1);
-  return car(car(args));
+fn_mod(size_t argc, obj_t *argv) {
+  return fn2_mod(argv[0], argv[1]);
 }
 
 obj_t
-fn_cdr(obj_t args) {
-  assert_argcount(args, 1);
-  return cdr(car(args));
+fn_car(size_t argc, obj_t *argv) {
+  return car(argv[0]);
 }
 
 obj_t
-fn_cons(obj_t args) {
-  assert_argcount(args, 2);
-  return cons(car(args), car(cdr(args)));
+fn_cdr(size_t argc, obj_t *argv) {
+  return cdr(argv[0]);
 }
 
 obj_t
-fn_consp(obj_t args) {
-  assert_argcount(args, 1);
-  return consp(car(args))? t: nil;
+fn_cons(size_t argc, obj_t *argv) {
+  return cons(argv[0], argv[1]);
 }
 
 obj_t
-fn_funp(obj_t args) {
-  assert_argcount(args, 1);
-  return funcp(car(args))? t: nil;
+fn2_rplaca(obj_t cell, obj_t val) {
+  if (!consp(cell))
+    error(E_INVALID_ARG, cell);
+  rplaca(cell, val);
+  return cell;
 }
 
 obj_t
-fn_mintp(obj_t args) {
-  assert_argcount(args, 1);
-  return mintp(car(args))? t: nil;
+fn_rplaca(size_t argc, obj_t *argv) {
+  return fn2_rplaca(argv[0], argv[1]);
 }
 
 obj_t
-fn_nullp(obj_t args) {
-  assert_argcount(args, 1);
-  return nullp(car(args))? t: nil;
+fn2_rplacd(obj_t cell, obj_t val) {
+  if (!consp(cell))
+    error(E_INVALID_ARG, cell);
+  rplacd(cell, val);
+  return cell;
 }
 
 obj_t
-fn_symp(obj_t args) {
-  assert_argcount(args, 1);
-  return symp(car(args))? t: nil;
+fn_rplacd(size_t argc, obj_t *argv) {
+  return fn2_rplacd(argv[0], argv[1]);
 }
 
 obj_t
-copy_list(obj_t args) {
-  if (consp(args))
-    return cons(car(args), copy_list(cdr(args)));
-  return args;
+fn1_consp(obj_t x) {
+  return consp(x)? t : nil;
+}
+
+obj_t
+fn_consp(size_t argc, obj_t *argv) {
+  return fn1_consp(argv[0]);
+}
+
+obj_t
+fn1_funp(obj_t x) {
+  return funcp(x)? t : nil;
+}
+
+obj_t
+fn_funp(size_t argc, obj_t *argv) {
+  return fn1_funp(argv[0]);
+}
+
+obj_t
+fn1_mintp(obj_t x) {
+  return mintp(x)? t : nil;
+}
+
+obj_t
+fn_mintp(size_t argc, obj_t *argv) {
+  return fn1_mintp(argv[0]);
+}
+
+obj_t
+fn1_integerp(obj_t x) {
+  return integerp(x)? t : nil;
+}
+
+obj_t
+fn_integerp(size_t argc, obj_t *argv) {
+  return fn1_integerp(argv[0]);
+}
+
+obj_t
+fn1_nullp(obj_t x) {
+  return nullp(x)? t : nil;
+}
+
+obj_t
+fn_nullp(size_t argc, obj_t *argv) {
+  return fn1_nullp(argv[0]);
+}
+
+obj_t
+fn1_symp(obj_t x) {
+  return symp(x)? t : nil;
+}
+
+obj_t
+fn_symp(size_t argc, obj_t *argv) {
+  return fn1_symp(argv[0]);
 }
 
 obj_t
-fn_list(obj_t args) {
-  return copy_list(args);
+fn_list(size_t argc, obj_t *argv) {
+  return list_from_args(argc, argv);
 }
@@ -0,0 +1,832 @@
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "lisp.h"
+#include "hash.h"
+#include "builtins.h"
+#include "bytecode.h"
+
+extern jmp_buf errhandler;
+extern obj_t errobj;
+extern obj_t quasiquote, unquote, unquote_splice;
+
+bytecode_t uncompilable;
+
+// A lexical variable as the function being compiled sees it: in a
+//  local slot, or in a slot of its env.  Variables are numbered in
+//  the order they're bound over the whole of a compile, and a capture
+//  has the number of the variable it captures.
+typedef struct var {
+  obj_t name;
+  size_t id;
+  size_t slot;
+  bool in_env;
+} var_t;
+
+// Each capture also remembers where the function around finds it.
+typedef struct capture {
+  obj_t name;
+  var_t from;
+} capture_t;
+
+// What's known about a variable.  One that's both captured and
+//  assigned has to be boxed, for closures to see the same value; when
+//  that turns up, the whole lexical function is compiled again with
+//  the variable boxed from the start.
+#define VAR_CAPTURED 1
+#define VAR_ASSIGNED 2
+#define VAR_BOXED 4
+
+typedef struct compiler {
+  code_t *code;
+  size_t ncode;
+  size_t capacity;
+
+  // The constants so far, most recent first.  This is a root while
+  //  compiling, since macros get expanded along the way.
+  obj_t consts;
+  size_t nconsts;
+
+  // For a lexical function, the variables in scope, innermost last,
+  //  and the ones captured from the functions around it, which are
+  //  compiled along with it.  Slots are handed out like a stack.
+  bool lexical;
+  struct compiler *outer, *root;
+  var_t *scope;
+  size_t nscope, scope_size;
+  capture_t *captures;
+  size_t ncaptures, captures_size;
+  size_t nslots, max_slots;
+
+  // Kept by the root compiler, for every variable.
+  uint8_t *var_flags;
+  size_t nvars, var_flags_size;
+} compiler_t;
+
+// The innermost compiler at work, to free them all after an error.
+compiler_t *compiling = NULL;
+
+// Builtins with an instruction of their own, for a given number of
+//  arguments.
+struct {
+  builtin_t *fn;
+  size_t argc;
+  enum opcode op;
+} inline_builtins[] = {
+  {fn_add, 2, OP_ADD},
+  {fn_sub, 2, OP_SUB},
+  {fn_mul, 2, OP_MUL},
+  {fn_less, 2, OP_LESS},
+  {fn_greater, 2, OP_GREATER},
+  {fn_lesseq, 2, OP_LESSEQ},
+  {fn_greatereq, 2, OP_GREATEREQ},
+  {fn_equal, 2, OP_EQUAL},
+  {fn_car, 1, OP_CAR},
+  {fn_cdr, 1, OP_CDR},
+  {fn_nullp, 1, OP_NULLP},
+  {fn_cons, 2, OP_CONS},
+};
+
+// Whether compiled code may run f as an instruction, with no frame,
+//  which leaves the profiler nothing honest to say about it.
+bool
+inlined_builtin(func_t *f) {
+  if (getftype(f) != FTYPE_COMPILED) return false;
+  for (size_t n = 0; n < sizeof(inline_builtins)/sizeof(*inline_builtins); n++)
+    if (inline_builtins[n].fn == as_compiled(f)) return true;
+  return false;
+}
+
+
+void
+emit(compiler_t *c, code_t word) {
+  if (c->ncode == c->capacity) {
+    c->capacity = c->capacity? c->capacity * 2 : 64;
+    c->code = realloc(c->code, sizeof(code_t) * c->capacity);
+    if (!c->code) die();
+  }
+  c->code[c->ncode++] = word;
+}
+
+// Returns the index of a constant, adding it if it's new.
+code_t
+constant(compiler_t *c, obj_t obj) {
+  size_t idx = c->nconsts;
+  for (obj_t ptr = c->consts; consp(ptr); ptr = cdr(ptr)) {
+    idx--;
+    if (eqp(car(ptr), obj)) return idx;
+  }
+  c->consts = cons(obj, c->consts);
+  return c->nconsts++;
+}
+
+// Emits a jump whose target isn't known yet.  Jumps to the same place
+//  are chained through their operands until patch_jumps() fills them
+//  all in with the current position.
+void
+emit_jump(compiler_t *c, enum opcode op, code_t *chain) {
+  emit(c, op);
+  emit(c, *chain);
+  *chain = c->ncode - 1;
+}
+
+void
+patch_jumps(compiler_t *c, code_t chain) {
+  while (chain >= 0) {
+    code_t next = c->code[chain];
+    c->code[chain] = c->ncode;
+    chain = next;
+  }
+}
+
+// Returns the length of a proper list, or -1 for anything else.
+long
+list_length(obj_t list) {
+  long len = 0;
+  for (; consp(list); list = cdr(list)) len++;
+  return nullp(list)? len : -1;
+}
+
+// nil, t and anything that has been def'd can never change.
+bool
+constantp(sym_t *sym) {
+  return sym->flags & SYM_CONSTANT;
+}
+
+
+// Numbers a new variable, keeping only whether it was boxed from any
+//  earlier time round.
+size_t
+new_var(compiler_t *c) {
+  compiler_t *root = c->root;
+  if (root->nvars == root->var_flags_size) {
+    size_t size = root->var_flags_size? 2 * root->var_flags_size : 64;
+    root->var_flags = realloc(root->var_flags, size);
+    if (!root->var_flags) die();
+    memset(&root->var_flags[root->nvars], 0, size - root->nvars);
+    root->var_flags_size = size;
+  }
+  root->var_flags[root->nvars] &= VAR_BOXED;
+  return root->nvars++;
+}
+
+static inline bool
+boxedp(compiler_t *c, size_t id) {
+  return c->root->var_flags[id] & VAR_BOXED;
+}
+
+// Gives name the next local slot.  Like a dynamic binding, it can't
+//  shadow a constant.
+void
+bind_local(compiler_t *c, obj_t name) {
+  if (!symp(name) || nullp(name))
+    error(E_INVALID_NAME, name);
+  if (constantp(as_sym(name)))
+    error(E_REDEFINE, name);
+
+  if (c->nscope == c->scope_size) {
+    c->scope_size = c->scope_size? 2 * c->scope_size : 16;
+    c->scope = realloc(c->scope, sizeof(var_t) * c->scope_size);
+    if (!c->scope) die();
+  }
+  c->scope[c->nscope++] = (var_t){name, new_var(c), c->nslots++, false};
+  if (c->nslots > c->max_slots)
+    c->max_slots = c->nslots;
+}
+
+// Leaves only the first depth variables in scope.
+void
+unbind_locals(compiler_t *c, size_t depth) {
+  c->nslots -= c->nscope - depth;
+  c->nscope = depth;
+}
+
+void
+add_capture(compiler_t *c, obj_t name, var_t from) {
+  if (c->ncaptures == c->captures_size) {
+    c->captures_size = c->captures_size? 2 * c->captures_size : 8;
+    c->captures = realloc(c->captures, sizeof(capture_t) * c->captures_size);
+    if (!c->captures) die();
+  }
+  c->captures[c->ncaptures++] = (capture_t){name, from};
+}
+
+// Finds a lexical variable, capturing it from the functions around if
+//  that's where it is.  Slot 0 of an env is the function it's for.
+bool
+resolve(compiler_t *c, obj_t name, var_t *var) {
+  if (!c->lexical) return false;
+  for (size_t n = c->nscope; n--;)
+    if (eqp(c->scope[n].name, name)) {
+      *var = c->scope[n];
+      return true;
+    }
+  for (size_t n = 0; n < c->ncaptures; n++)
+    if (eqp(c->captures[n].name, name)) {
+      *var = (var_t){name, c->captures[n].from.id, n + 1, true};
+      return true;
+    }
+
+  var_t from;
+  if (!c->outer || !resolve(c->outer, name, &from))
+    return false;
+  c->root->var_flags[from.id] |= VAR_CAPTURED;
+  add_capture(c, name, from);
+  *var = (var_t){name, from.id, c->ncaptures, true};
+  return true;
+}
+
+void
+emit_var(compiler_t *c, var_t *var, bool unbox) {
+  emit(c, var->in_env? OP_ENV : OP_LOCAL);
+  emit(c, var->slot);
+  if (unbox && boxedp(c, var->id))
+    emit(c, OP_UNBOX);
+}
+
+// Boxes those of the variables from depth up that need it, once they
+//  have their values.
+void
+box_locals(compiler_t *c, size_t depth) {
+  for (size_t n = depth; n < c->nscope; n++)
+    if (boxedp(c, c->scope[n].id)) {
+      emit(c, OP_BOX);
+      emit(c, c->scope[n].slot);
+    }
+}
+
+// Marks any variable that has turned out to need a box, returning
+//  whether there were any.
+bool
+rebox(compiler_t *c) {
+  bool again = false;
+  for (size_t n = 0; n < c->nvars; n++)
+    if ((c->var_flags[n] & (VAR_CAPTURED | VAR_ASSIGNED | VAR_BOXED))
+	== (VAR_CAPTURED | VAR_ASSIGNED)) {
+      c->var_flags[n] |= VAR_BOXED;
+      again = true;
+    }
+  return again;
+}
+
+// Returns a lexical variable that form mentions anywhere, or else nil.
+//  A form that does can't be left to the interpreter, which would look
+//  the name up as a global instead.
+obj_t
+lexical_mention(compiler_t *c, obj_t form) {
+  if (consp(form)) {
+    for (; consp(form); form = cdr(form)) {
+      obj_t found = lexical_mention(c, car(form));
+      if (!nullp(found)) return found;
+    }
+    return nullp(form)? nil : lexical_mention(c, form);
+  }
+  if (!symp(form)) return nil;
+  for (; c && c->lexical; c = c->outer) {
+    for (size_t n = 0; n < c->nscope; n++)
+      if (eqp(c->scope[n].name, form)) return form;
+    for (size_t n = 0; n < c->ncaptures; n++)
+      if (eqp(c->captures[n].name, form)) return form;
+  }
+  return nil;
+}
+
+void
+check_interpretable(compiler_t *c, obj_t form) {
+  obj_t found = c->lexical? lexical_mention(c, form) : nil;
+  if (!nullp(found))
+    error(E_LEXICAL, found);
+}
+
+void
+discard(compiler_t *c) {
+  free(c->code);
+  free(c->scope);
+  free(c->captures);
+  if (c->root == c)
+    free(c->var_flags);
+}
+
+
+void compile_form(compiler_t *c, obj_t form, bool tail);
+
+// Leaves the value of the last form, or nil if there are none.
+void
+compile_body(compiler_t *c, obj_t body, bool tail) {
+  if (!consp(body)) {
+    emit(c, OP_CONST);
+    emit(c, constant(c, nil));
+    return;
+  }
+  protect(&body);
+  while (consp(cdr(body))) {
+    compile_form(c, car(body), false);
+    emit(c, OP_POP);
+    body = cdr(body);
+  }
+  compile_form(c, car(body), tail);
+  unprotect(1);
+}
+
+// Pushes each argument in order, returning how many there were.
+size_t
+compile_args(compiler_t *c, obj_t args) {
+  size_t argc = 0;
+  protect(&args);
+  for (; consp(args); args = cdr(args), argc++)
+    compile_form(c, car(args), false);
+  unprotect(1);
+  return argc;
+}
+
+void
+compile_cond(compiler_t *c, obj_t args, bool tail) {
+  code_t done = -1;
+  protect(&args);
+  while (!nullp(car(args))) {
+    code_t next = -1;
+    compile_form(c, car(args), false);
+    emit_jump(c, OP_JUMP_IF_NIL, &next);
+    compile_form(c, car(cdr(args)), tail);
+    emit_jump(c, OP_JUMP, &done);
+    patch_jumps(c, next);
+    args = cdr(cdr(args));
+  }
+  unprotect(1);
+  emit(c, OP_CONST);
+  emit(c, constant(c, nil));
+  patch_jumps(c, done);
+}
+
+// and and or stop at the first form whose value is or isn't nil.
+void
+compile_and_or(compiler_t *c, enum opcode op, obj_t args, bool tail) {
+  code_t done = -1;
+  protect(&args);
+  while (consp(cdr(args))) {
+    compile_form(c, car(args), false);
+    emit_jump(c, op, &done);
+    args = cdr(args);
+  }
+  compile_form(c, car(args), tail);
+  unprotect(1);
+  patch_jumps(c, done);
+}
+
+// Setting a lexical variable leaves its name, as set always does.  One
+//  captured but not yet boxed will be on the next time round.
+void
+compile_set_var(compiler_t *c, var_t *var, obj_t val) {
+  c->root->var_flags[var->id] |= VAR_ASSIGNED;
+  if (boxedp(c, var->id)) {
+    emit_var(c, var, false);
+    compile_form(c, val, false);
+    emit(c, OP_SET_BOX);
+  } else {
+    compile_form(c, val, false);
+    emit(c, var->in_env? OP_POP : OP_SET_LOCAL);
+    if (!var->in_env) emit(c, var->slot);
+  }
+  emit(c, OP_CONST);
+  emit(c, constant(c, var->name));
+}
+
+// Compiles set or def of each variable in turn, if the names are all
+//  symbols that could be assigned.  Returns whether it did.
+bool
+compile_assignments(compiler_t *c, enum opcode op, obj_t args) {
+  long len = list_length(args);
+  if (len <= 0 || len % 2) return false;
+  for (obj_t ptr = args; consp(ptr); ptr = cdr(cdr(ptr)))
+    if (!symp(car(ptr)) || nullp(car(ptr)))
+      return false;
+
+  protect(&args);
+  while (consp(args)) {
+    var_t var;
+    if (op == OP_SET && resolve(c, car(args), &var))
+      compile_set_var(c, &var, car(cdr(args)));
+    else {
+      compile_form(c, car(cdr(args)), false);
+      emit(c, op);
+      emit(c, constant(c, car(args)));
+    }
+    args = cdr(cdr(args));
+    if (consp(args))
+      emit(c, OP_POP);
+  }
+  unprotect(1);
+  return true;
+}
+
+// Builds the same structure as op_quasiquote(), only with the
+//  unquoted forms compiled, so that they see lexical variables.
+void
+compile_quasiquote(compiler_t *c, obj_t args) {
+  if (!consp(args)) {
+    emit(c, OP_CONST);
+    emit(c, constant(c, args));
+    return;
+  }
+  if (eqp(car(args), unquote)) {
+    compile_form(c, cdr(args), false);
+    return;
+  }
+
+  protect(&args);
+  compile_quasiquote(c, car(args));
+  if (eqp(car(car(cdr(args))), unquote_splice)) {
+    compile_form(c, cdr(car(cdr(args))), false);
+    compile_quasiquote(c, cdr(cdr(args)));
+    emit(c, OP_NAPPEND);
+  } else compile_quasiquote(c, cdr(args));
+  emit(c, OP_CONS);
+  unprotect(1);
+}
+
+void compile_lexical_body(compiler_t *c, func_t *f);
+bytecode_t *assemble(compiler_t *c, func_t *f);
+
+// A lambda inside a lexical function is compiled along with it, into
+//  a function that closures are made from with the values of whatever
+//  it captures, or that is itself the value if it captures nothing.
+void
+compile_closure(compiler_t *c, obj_t source) {
+  obj_t fn = make_func(make_interp_func(FTYPE_INTERP, source, true));
+  protect(&fn);
+
+  compiler_t inner = {.consts = nil, .lexical = true,
+		      .outer = c, .root = c->root};
+  compiling = &inner;
+  protect(&inner.consts);
+  compile_lexical_body(&inner, as_func(fn));
+  as_func(fn)->code = assemble(&inner, as_func(fn));
+  unprotect(1);
+  compiling = c;
+
+  obj_t names = nil;
+  protect(&names);
+  for (size_t n = inner.ncaptures; n--;) {
+    obj_t name = inner.captures[n].name;
+    if (boxedp(c, inner.captures[n].from.id))
+      name = cons(name, nil);
+    names = cons(name, names);
+  }
+  as_func(fn)->env = names;
+  write_barrier(fn, names);
+  unprotect(1);
+
+  code_t k = constant(c, fn);
+  if (inner.ncaptures) {
+    for (size_t n = 0; n < inner.ncaptures; n++)
+      emit_var(c, &inner.captures[n].from, false);
+    emit(c, OP_CLOSURE);
+    emit(c, k);
+    emit(c, inner.ncaptures);
+  } else {
+    emit(c, OP_CONST);
+    emit(c, k);
+  }
+  discard(&inner);
+  unprotect(1);
+}
+
+// ((lambda (names...) body...) args...), as let expands to, binds the
+//  names to more local slots rather than making a closure to call.
+bool
+inline_lambdap(compiler_t *c, obj_t head, obj_t args) {
+  if (!c->lexical || !consp(head) || !symp(car(head)))
+    return false;
+  sym_t *sym = as_sym(car(head));
+  if (!constantp(sym) || !funcp(sym->val)
+      || getftype(as_func(sym->val)) != FTYPE_SPECIAL)
+    return false;
+  special_t *op = as_special(as_func(sym->val));
+  if (op != op_lambda && op != op_lambda_star)
+    return false;
+  long nparams = list_length(car(cdr(head)));
+  return nparams >= 0 && nparams == list_length(args);
+}
+
+void
+compile_inline_lambda(compiler_t *c, obj_t head, obj_t args, bool tail) {
+  protect(&head);
+  size_t depth = c->nscope;
+  compile_args(c, args);
+  for (obj_t params = car(cdr(head)); consp(params); params = cdr(params))
+    bind_local(c, car(params));
+  for (size_t n = c->nscope; n-- > depth;) {
+    emit(c, OP_SET_LOCAL);
+    emit(c, c->scope[n].slot);
+  }
+  box_locals(c, depth);
+  compile_body(c, cdr(cdr(head)), tail);
+  unbind_locals(c, depth);
+  unprotect(1);
+}
+
+void
+compile_special(compiler_t *c, func_t *f, obj_t args, bool tail) {
+  special_t *op = as_special(f);
+
+  if (c->lexical && (op == op_lambda || op == op_lambda_star)
+      && consp(args)) {
+    compile_closure(c, args);
+    return;
+  } else if (c->lexical && op == op_quasiquote) {
+    compile_quasiquote(c, args);
+    return;
+  }
+
+  if (op == op_quote) {
+    emit(c, OP_CONST);
+    emit(c, constant(c, args));
+    return;
+  } else if (op == op_cond && list_length(args) >= 0) {
+    compile_cond(c, args, tail);
+    return;
+  } else if (op == op_do && consp(args)) {
+    compile_body(c, args, tail);
+    return;
+  } else if (op == op_and && list_length(args) > 0) {
+    compile_and_or(c, OP_AND, args, tail);
+    return;
+  } else if (op == op_or && list_length(args) > 0) {
+    compile_and_or(c, OP_OR, args, tail);
+    return;
+  } else if (op == op_set && compile_assignments(c, OP_SET, args)) {
+    return;
+  } else if (op == op_def && compile_assignments(c, OP_DEF, args)) {
+    return;
+  } else if (op == op_profile && consp(args)) {
+    emit(c, OP_PROFILE);
+    compile_form(c, car(args), false);
+    emit(c, OP_END_PROFILE);
+    return;
+  }
+
+  // Everything else is left to the special form itself.  The body of
+  //  a macro is never evaluated where lexical variables are.
+  if (op != op_mu)
+    check_interpretable(c, args);
+  protect(&args);
+  code_t k = constant(c, make_func(f));
+  emit(c, OP_SPECIAL);
+  emit(c, k);
+  emit(c, constant(c, args));
+  unprotect(1);
+}
+
+void
+compile_builtin(compiler_t *c, func_t *f, obj_t args) {
+  size_t argc = compile_args(c, args);
+  builtin_t *fn = as_compiled(f);
+
+  for (size_t n = 0; n < sizeof(inline_builtins)/sizeof(*inline_builtins); n++)
+    if (inline_builtins[n].fn == fn && inline_builtins[n].argc == argc) {
+      emit(c, inline_builtins[n].op);
+      return;
+    }
+  emit(c, OP_BUILTIN);
+  emit(c, constant(c, make_func(f)));
+  emit(c, argc);
+}
+
+// Constant symbols are looked up now, and calls through them are
+//  compiled to suit what they name: macros are expanded in place, and
+//  special forms compiled into jumps where possible.  A call through
+//  anything else has to check at run time what it's calling.  A call
+//  in tail position reuses the caller's frame.
+void
+compile_form(compiler_t *c, obj_t form, bool tail) {
+  switch (gettype(form)) {
+  case TYPE_MINT:
+  case TYPE_FUNC:
+  case TYPE_STRING:
+  case TYPE_VECTOR:
+  case TYPE_BIGNUM:
+  case TYPE_TABLE:
+    emit(c, OP_CONST);
+    emit(c, constant(c, form));
+    return;
+  case TYPE_SYM: {
+    var_t var;
+    if (resolve(c, form, &var))
+      emit_var(c, &var, true);
+    else if (constantp(as_sym(form))) {
+      emit(c, OP_CONST);
+      emit(c, constant(c, sym_value(as_sym(form))));
+    } else {
+      emit(c, OP_VAR);
+      emit(c, constant(c, form));
+    }
+    return;
+  } case TYPE_CONS:
+    break;
+  }
+
+  protect(&form);
+  obj_t head = car(form);
+  bool proper = list_length(cdr(form)) >= 0;
+
+  if (inline_lambdap(c, head, cdr(form))) {
+    compile_inline_lambda(c, head, cdr(form), tail);
+    unprotect(1);
+    return;
+  }
+
+  // Lexical code is compiled before it first runs, so it can expand
+  //  the macros that are defined by then, even ones that could change.
+  if (symp(head) && funcp(as_sym(head)->val)
+      && (constantp(as_sym(head))
+	  || (c->lexical && getftype(as_func(as_sym(head)->val)) == FTYPE_MACRO
+	      && nullp(lexical_mention(c, head))))) {
+    func_t *f = as_func(as_sym(head)->val);
+    switch (getftype(f)) {
+    case FTYPE_SPECIAL:
+      compile_special(c, f, cdr(form), tail);
+      unprotect(1);
+      return;
+    case FTYPE_MACRO: {
+      obj_t expansion = expand_macro(f, cdr(form));
+      protect(&expansion);
+      compile_form(c, expansion, tail);
+      unprotect(2);
+      return;
+    } case FTYPE_COMPILED:
+      if (!proper) break;
+      compile_builtin(c, f, cdr(form));
+      unprotect(1);
+      return;
+    case FTYPE_INTERP:
+      if (!proper) break;
+      emit(c, OP_CONST);
+      emit(c, constant(c, make_func(f)));
+      size_t argc = compile_args(c, cdr(form));
+      emit(c, tail? OP_TAIL_CALL : OP_CALL);
+      emit(c, argc);
+      emit(c, constant(c, car(form)));
+      unprotect(1);
+      return;
+    }
+  }
+
+  if (!proper) {
+    check_interpretable(c, form);
+    emit(c, OP_EVAL);
+    emit(c, constant(c, form));
+    unprotect(1);
+    return;
+  }
+
+  code_t done = -1;
+  compile_form(c, head, false);
+  obj_t found = c->lexical? lexical_mention(c, cdr(form)) : nil;
+  emit(c, OP_CHECK_CALL);
+  emit(c, constant(c, nullp(found)? form : found));
+  emit(c, done);
+  done = c->ncode - 1;
+  size_t argc = compile_args(c, cdr(form));
+  emit(c, tail? OP_TAIL_CALL : OP_CALL);
+  emit(c, argc);
+  emit(c, constant(c, symp(car(form))? car(form) : nil));
+  patch_jumps(c, done);
+  unprotect(1);
+}
+
+
+// The parameters of a lexical function are its first local slots.
+void
+compile_lexical_body(compiler_t *c, func_t *f) {
+  obj_t params = car(make_cons(as_interp(f)));
+  for (; consp(params); params = cdr(params))
+    bind_local(c, car(params));
+  if (!nullp(params))
+    bind_local(c, params);
+  box_locals(c, 0);
+  compile_body(c, as_interp(f)->cdr, true);
+  emit(c, OP_RETURN);
+}
+
+// Compiles a lexical function that isn't inside another, over again
+//  until no more variables turn out to need boxes.  One compiled
+//  before, and then loaded from an image, knows what it captures from
+//  the names in its env.
+void
+compile_lexical(compiler_t *c, func_t *f) {
+  do {
+    c->ncode = 0;
+    c->consts = nil;
+    c->nconsts = 0;
+    c->nscope = c->ncaptures = 0;
+    c->nslots = c->max_slots = 0;
+    c->nvars = 0;
+    for (obj_t names = f->env; consp(names); names = cdr(names)) {
+      obj_t name = car(names);
+      size_t id = new_var(c);
+      if (consp(name)) {
+	name = car(name);
+	c->var_flags[id] |= VAR_BOXED;
+      }
+      add_capture(c, name, (var_t){name, id, 0, false});
+    }
+    compile_lexical_body(c, f);
+  } while (rebox(c));
+}
+
+bytecode_t *
+assemble(compiler_t *c, func_t *f) {
+  bytecode_t *code = malloc(sizeof(bytecode_t) + sizeof(code_t) * c->ncode);
+  if (!code) die();
+  code->nconsts = c->nconsts;
+  code->consts = malloc(sizeof(obj_t) * c->nconsts);
+  if (!code->consts) die();
+  code->nlocals = c->max_slots;
+  code->ncode = c->ncode;
+  memcpy(code->code, c->code, sizeof(code_t) * c->ncode);
+
+  size_t n = c->nconsts;
+  for (obj_t ptr = c->consts; consp(ptr); ptr = cdr(ptr)) {
+    code->consts[--n] = car(ptr);
+    write_barrier(make_func(f), car(ptr));
+  }
+  return code;
+}
+
+// Compiles the body of an interpreted function or macro.  Macros used
+//  in the body are expanded now, so if one fails the body is left to
+//  the interpreter, which will report the error if the call is ever
+//  actually reached.  A lexical function can't be interpreted, so the
+//  error is reported now instead.  A closure gets the code of the
+//  function it was made from.
+void
+compile_function(func_t *f) {
+  if (closurep(f)) {
+    func_t *template = closure_template(f);
+    if (!template->code)
+      compile_function(template);
+    if (has_bytecode(template))
+      f->code = template->code;
+    return;
+  }
+
+  compiler_t *c = calloc(1, sizeof(compiler_t));
+  if (!c) die();
+  c->consts = nil;
+  c->lexical = f->lexical;
+  c->root = c;
+
+  jmp_buf saved;
+  memcpy(saved, errhandler, sizeof(jmp_buf));
+  size_t roots = root_depth, values = value_depth, bindings = binding_depth;
+  size_t frames = frame_depth;
+  bool traced = tracing;
+  compiler_t *outer = compiling;
+  compiling = c;
+
+  // A profile started by a macro is stopped by its error here, as it
+  //  would be at the top level.
+  int ecode = setjmp(errhandler);
+  if (ecode) {
+    memcpy(errhandler, saved, sizeof(jmp_buf));
+    if (tracing && !traced) stop_tracing();
+    root_depth = roots;
+    value_depth = values;
+    frame_depth = frames;
+    unbind_to(bindings);
+    for (compiler_t *inner = compiling; inner != c; inner = inner->outer)
+      discard(inner);
+    discard(c);
+    free(c);
+    compiling = outer;
+    if (f->lexical) {
+      f->code = NULL;
+      error(ecode, errobj);
+    }
+    return;
+  }
+
+  // Calls to f made while expanding its macros are interpreted.
+  f->code = &uncompilable;
+  protect(&c->consts);
+  if (f->lexical)
+    compile_lexical(c, f);
+  else {
+    compile_body(c, as_interp(f)->cdr, true);
+    emit(c, OP_RETURN);
+  }
+  bytecode_t *code = assemble(c, f);
+  unprotect(1);
+
+  memcpy(errhandler, saved, sizeof(jmp_buf));
+  compiling = outer;
+  f->code = code;
+  discard(c);
+  free(c);
+}
+
+void
+free_bytecode(bytecode_t *code) {
+  free(code->consts);
+  free(code);
+}
@@ -3,15 +3,71 @@
 #include <string.h>
 #include <stdint.h>
 #include <limits.h>
+#include <time.h>
 #include "lisp.h"
 #include "hash.h"
+#include "bytecode.h"
 
 #define INITIAL_STORE_SIZE 512
 #define FREELIST_ENTRY_BITS (CHAR_BIT * sizeof(*free_list))
+
+// The store is reserved up front and only ever grows into the
+//  reservation, so cons pointers stay valid when it expands.
+#define MAX_STORE_SIZE ((size_t)1 << 30)
+
 size_t store_size = 0;
 cons_t *free_store = NULL;
 size_t *free_list = NULL;
 
+// Allocation resumes scanning at the bitmap word where it last
+//  succeeded, rather than at word 0 every time.
+size_t alloc_cursor = 0;
+
+// Freshly grown store is known to be empty, so it is handed out in
+//  order without consulting the bitmap at all.
+size_t bump_next = 0;
+size_t bump_limit = 0;
+
+// Reachability bits for the cell with the same index, filled in
+//  during marking and then swapped in as the new free_list.
+size_t *mark_bits = NULL;
+
+// Every C variable holding an obj_t across a possible collection.
+#define ROOT_STACK_SIZE ((size_t)1 << 20)
+obj_t *root_stack[ROOT_STACK_SIZE];
+size_t root_depth = 0;
+
+obj_t value_stack[VALUE_STACK_SIZE];
+size_t value_depth = 0;
+
+// New conses are bump-allocated in the nursery.  When it fills, the
+//  cells still reachable are copied out into the store and the whole
+//  nursery is reused, so short-lived conses cost almost nothing.
+#define NURSERY_SIZE ((size_t)1 << 15)
+cons_t *nursery_start = NULL;
+cons_t *nursery_end = NULL;
+cons_t *nursery_next = NULL;
+
+// Conses handed out by nurseries that have since been emptied.
+size_t nursery_conses = 0;
+
+gc_stats_t gc_stats;
+
+// Older objects that have had a nursery pointer stored into them
+//  since the last minor collection.
+#define REMEMBERED_SIZE ((size_t)1 << 20)
+obj_t remembered[REMEMBERED_SIZE];
+size_t nremembered = 0;
+
+// Cells promoted during the current minor collection that still
+//  need their own fields forwarded.
+cons_t **promoted = NULL;
+size_t npromoted = 0;
+
+// Cells in use in the store, so a minor collection can tell whether
+//  the survivors are guaranteed to fit.
+size_t store_used = 0;
+
 
 extern symt_t *symtable;
 
@@ -20,123 +76,443 @@ bool
 already_used(size_t idx) {
   size_t entry = idx / FREELIST_ENTRY_BITS;
   size_t bit = idx % FREELIST_ENTRY_BITS;
-  return (free_list[entry] & (1L << bit)) != 0;
+  return (free_list[entry] & ((size_t)1 << bit)) != 0;
 }
 
 void
 mark_used(size_t idx) {
   size_t entry = idx / FREELIST_ENTRY_BITS;
   size_t bit = idx % FREELIST_ENTRY_BITS;
-  free_list[entry] |= 1L << bit;
+  free_list[entry] |= (size_t)1 << bit;
 }
 
+// Reserved memory is zero-filled, so growing the store is just a
+//  matter of moving its end; pages are only touched once handed out.
 void
 allocate_store(size_t ncells) {
-  free_store = realloc(free_store, sizeof(cons_t) * ncells);
-  free_list = realloc(free_list, ncells / CHAR_BIT);
-  bzero(free_list + store_size,
-	(ncells - store_size) / CHAR_BIT);
+  if (!free_store) {
+    free_store = reserve(sizeof(cons_t) * MAX_STORE_SIZE);
+    free_list = reserve(MAX_STORE_SIZE / CHAR_BIT);
+    mark_bits = reserve(MAX_STORE_SIZE / CHAR_BIT);
+  }
+  if (ncells > MAX_STORE_SIZE) {
+    fputs("* OUT OF CONS STORE\n", stderr);
+    abort();
+  }
+
+  bump_next = store_size;
+  bump_limit = ncells;
   store_size = ncells;
 }
 
 
 cons_t *
 find_next_free_cons() {
-  
-  if (!free_store) {
+
+  if (!free_store)
     allocate_store(INITIAL_STORE_SIZE);
-    mark_used(0);
-    return &free_store[0];
-  }
-
-  for (size_t entry = 0; entry < store_size / FREELIST_ENTRY_BITS; entry++) {
-    if (~entry) {
-      for (size_t bit = 0; bit < FREELIST_ENTRY_BITS; bit++) {
-	if ((free_list[entry] & (1L<<bit)) == 0) {
-	  free_list[entry] |= (1L << bit);
-	  return &free_store[entry*FREELIST_ENTRY_BITS + bit];
-	}
-      }
+
+  if (bump_next < bump_limit) {
+    mark_used(bump_next);
+    return &free_store[bump_next++];
+  }
+
+  size_t nentries = store_size / FREELIST_ENTRY_BITS;
+  for (size_t entry = alloc_cursor; entry < nentries; entry++) {
+    size_t free_bits = ~free_list[entry];
+    if (free_bits) {
+      size_t bit = __builtin_ctzl(free_bits);
+      free_list[entry] |= (size_t)1 << bit;
+      gc_stats.words_scanned += entry - alloc_cursor + 1;
+      alloc_cursor = entry;
+      return &free_store[entry*FREELIST_ENTRY_BITS + bit];
     }
   }
+  gc_stats.words_scanned += nentries - alloc_cursor;
+  alloc_cursor = nentries;
   return NULL;
 }
 
+// Returns whether the cell was already marked, marking it if not.
+bool
+test_and_mark(cons_t *cell) {
+  size_t idx = cell - free_store;
+  size_t entry = idx / FREELIST_ENTRY_BITS;
+  size_t bit = (size_t)1 << (idx % FREELIST_ENTRY_BITS);
+  if (mark_bits[entry] & bit) return true;
+  mark_bits[entry] |= bit;
+  return false;
+}
+
+bool
+cons_marked(cons_t *cell) {
+  size_t idx = cell - free_store;
+  return mark_bits[idx / FREELIST_ENTRY_BITS]
+    & (size_t)1 << (idx % FREELIST_ENTRY_BITS);
+}
+
+// Cells that have been marked but whose fields haven't been looked
+//  at yet.  Marking works from this instead of recursing, so neither
+//  deep nor long structures can run it out of C stack.
+cons_t **mark_stack = NULL;
+size_t mark_depth = 0;
+size_t mark_capacity = 0;
+
+void
+push_mark(obj_t obj) {
+  // Strings and bignums hold no references.
+  if (stringp(obj)) {
+    as_string(obj)->head.marked = true;
+    return;
+  }
+  if (bignump(obj)) {
+    as_bignum(obj)->head.marked = true;
+    return;
+  }
+
+  // A vector's slots are marked right away, so vectors nested deeply
+  //  enough could still run out of C stack.
+  if (vectorp(obj)) {
+    vector_t *vec = as_vector(obj);
+    if (vec->head.marked) return;
+    vec->head.marked = true;
+    for (size_t n = 0; n < vec->len; n++)
+      push_mark(vec->slots[n]);
+    return;
+  }
+
+  if (tablep(obj)) {
+    table_t *tab = as_table(obj);
+    if (tab->head.marked) return;
+    tab->head.marked = true;
+    push_mark(tab->entries);
+    push_mark(tab->old);
+    return;
+  }
+
+  // Interpreted functions and macros keep their source and the
+  //  constants in their bytecode alive, and lexical functions their
+  //  env too.
+  if (funcp(obj)) {
+    func_t *f = as_func(obj);
+    if (func_test_and_mark(f)) return;
+    if (has_bytecode(f))
+      for (size_t n = 0; n < f->code->nconsts; n++)
+	push_mark(f->code->consts[n]);
+    if (f->lexical)
+      push_mark(f->env);
+    if (getftype(f) != FTYPE_INTERP && getftype(f) != FTYPE_MACRO)
+      return;
+    obj = make_cons(as_interp(f));
+  }
+
+  if (!consp(obj) || test_and_mark(as_cons(obj)))
+    return;
+
+  if (mark_depth == mark_capacity) {
+    mark_capacity = mark_capacity? mark_capacity * 2 : 1024;
+    mark_stack = realloc(mark_stack, sizeof(cons_t*) * mark_capacity);
+    if (!mark_stack) die();
+  }
+  // The cell will be popped soon, so start pulling it in now.
+  __builtin_prefetch(as_cons(obj));
+  mark_stack[mark_depth++] = as_cons(obj);
+}
+
 void
 mark_list(obj_t list) {
-  while (consp(list)) {
-    if (consp(car(list)))
-      mark_list(car(list));
+  push_mark(list);
+  while (mark_depth) {
+    cons_t *cell = mark_stack[--mark_depth];
+    push_mark(cell->cdr);
+    push_mark(cell->car);
+  }
+}
+
+// Collections nest, since a minor one can set off a full one, and
+//  only the outermost is timed as a pause.
+int pause_depth = 0;
+uint64_t pause_start;
 
-    size_t idx = as_cons(list) - free_store;
-    if (already_used(idx)) return;
-    mark_used(idx);
+uint64_t
+now_ns() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+begin_pause() {
+  if (!pause_depth++) pause_start = now_ns();
+}
+
+void
+end_pause() {
+  if (--pause_depth) return;
+  uint64_t ns = now_ns() - pause_start;
+  gc_stats.pauses++;
+  gc_stats.pause_ns += ns;
+  gc_stats.last_pause_ns = ns;
+  if (ns > gc_stats.max_pause_ns) gc_stats.max_pause_ns = ns;
+}
+
+// Marks everything reachable from the symbol table and the root,
+//  value and binding stacks, then frees every cell that wasn't
+//  marked.  The nursery must be empty.  Returns the number of cells
+//  that are still live.
+size_t
+garbage_collect() {
+  begin_pause();
+  size_t nentries = store_size / FREELIST_ENTRY_BITS;
+  memset(mark_bits, 0, nentries * sizeof(*mark_bits));
+  clear_func_marks();
+
+  for (size_t n = 0; n < symtable->nslots; n++) {
+    sym_t *sym = symtable->slots[n];
+    if (sym)
+      mark_list(sym->val);
+  }
+  for (size_t n = 0; n < root_depth; n++) {
+    mark_list(*root_stack[n]);
+  }
+  for (size_t n = 0; n < value_depth; n++) {
+    mark_list(value_stack[n]);
+  }
+  for (size_t n = 0; n < binding_depth; n++) {
+    mark_list(binding_stack[n].saved);
+  }
+  while (mark_expansions());
 
-    list = cdr(list);
+  size_t live = 0;
+  for (size_t entry = 0; entry < nentries; entry++) {
+    free_list[entry] = mark_bits[entry];
+    live += __builtin_popcountl(free_list[entry]);
   }
+
+  // Anything past the bump pointer was never handed out, so the
+  //  bitmap already knows it's free.
+  bump_next = bump_limit;
+  alloc_cursor = 0;
+
+  sweep_funcs();
+  sweep_objects();
+  sweep_expansions();
+  gc_stats.major_collections++;
+  if (store_used > live)
+    gc_stats.cells_reclaimed += store_used - live;
+  end_pause();
+  return store_used = live;
 }
 
+// Make sure the survivors of the next minor collection will fit in
+//  the store, since it can't be collected while that is underway.
+//  Collect it when they might not, and grow it as well whenever less
+//  than half of it comes back; otherwise a nearly full store would be
+//  collected after almost every minor collection.
 void
-mark_sym_and_children(sym_t *sym) {
-  if (!sym) return;
-  
-  mark_list(sym->val);
+make_room_for_nursery() {
+  if (store_size - store_used >= NURSERY_SIZE) return;
 
-  mark_sym_and_children(sym->next);
+  if (store_size && garbage_collect() <= store_size / 2
+      && store_size - store_used >= NURSERY_SIZE)
+    return;
+
+  size_t ncells = store_size? store_size * 2 : INITIAL_STORE_SIZE;
+  while (ncells - store_used < NURSERY_SIZE) ncells *= 2;
+  allocate_store(ncells);
 }
 
-cons_t *
-garbage_collect_and_find() {
-  size_t *old_list = free_list;
-  free_list = malloc(store_size / CHAR_BIT);
-  bzero(free_list, store_size / CHAR_BIT);
+// A nursery cell that has been copied out has this in its car, and
+//  the cell's new location in its cdr.
+static const obj_t forwarded = {TYPE_FUNC};
+
+int
+compare_objs(const void *a, const void *b) {
+  uintptr_t x = ((obj_t*)a)->_bits, y = ((obj_t*)b)->_bits;
+  return (x > y) - (x < y);
+}
+
+void
+remember(obj_t obj) {
+  if (nremembered && eqp(remembered[nremembered-1], obj))
+    return;
 
-  for (size_t n = 0; n < symtable->nitems; n++) {
-    mark_sym_and_children(symtable->table[n]);
+  if (nremembered == REMEMBERED_SIZE) {
+    // Only repeated stores into the same few objects can get here.
+    qsort(remembered, nremembered, sizeof(obj_t), compare_objs);
+    size_t n = 0;
+    for (size_t i = 0; i < nremembered; i++)
+      if (!n || !eqp(remembered[n-1], remembered[i]))
+	remembered[n++] = remembered[i];
+    nremembered = n;
+    if (n == REMEMBERED_SIZE) {
+      fputs("* REMEMBERED SET OVERFLOW\n", stderr);
+      abort();
+    }
   }
+  remembered[nremembered++] = obj;
+}
 
-  for (size_t entry = 0; entry < store_size / FREELIST_ENTRY_BITS; entry++) {
-    if (old_list[entry] != free_list[entry])
-      for (size_t bit = 0; bit < FREELIST_ENTRY_BITS; bit++) {
-	bool old = old_list[entry] & (1L<<bit);
-	bool new = free_list[entry] & (1L<<bit);
-	if (old && !new)
-	  printf("Freed cell %lu!\n", entry*FREELIST_ENTRY_BITS + bit);
-	else if (new && !old)
-	  printf("Wait, wha? %lu\n", entry*FREELIST_ENTRY_BITS + bit);
-      }
+void
+forward(obj_t *slot) {
+  obj_t obj = *slot;
+  if (!youngp(obj)) return;
+
+  cons_t *cell = as_cons(obj);
+  if (!eqp(cell->car, forwarded)) {
+    cons_t *copy = find_next_free_cons();
+    store_used++;
+    *copy = *cell;
+    cell->car = forwarded;
+    cell->cdr = make_cons(copy);
+    promoted[npromoted++] = copy;
   }
+  *slot = cell->cdr;
+}
 
-  free(old_list);
-  return NULL;
+// A function only holds a nursery cell in its source, constants or
+//  env if it went through write_barrier(), so this is only done for
+//  the ones in the remembered set.  Following functions from anywhere
+//  else would never end, since a recursive one is among its own
+//  constants.
+void
+forward_func(func_t *f) {
+  enum ftype type = getftype(f);
+  if (type == FTYPE_INTERP || type == FTYPE_MACRO) {
+    obj_t source = make_cons(as_interp(f));
+    forward(&source);
+    f->f = type == FTYPE_INTERP? make_interp(as_cons(source))
+      : make_macro(as_cons(source));
+  }
+  if (has_bytecode(f))
+    for (size_t n = 0; n < f->code->nconsts; n++)
+      forward(&f->code->consts[n]);
+  if (f->lexical)
+    forward(&f->env);
 }
 
-cons_t *
-expand_store_and_find() {
+// Copies every nursery cell reachable from the root, value and
+//  binding stacks, cached macro expansions, the remembered set, or
+//  the new cons's own fields out into the store.
+//  Nothing else can point into the nursery, so this only ever
+//  touches cells that survive.
+void
+collect_nursery(obj_t *car, obj_t *cdr) {
+  begin_pause();
+  size_t young = nursery_next - nursery_start;
+  size_t used = store_used;
+  nursery_conses += young;
+  if (!nursery_start) {
+    nursery_start = reserve(sizeof(cons_t) * NURSERY_SIZE);
+    nursery_end = nursery_start + NURSERY_SIZE;
+    promoted = reserve(sizeof(cons_t*) * NURSERY_SIZE);
+    make_room_for_nursery();
+  }
+
+  protect(car);
+  protect(cdr);
+  for (size_t n = 0; n < root_depth; n++)
+    forward(root_stack[n]);
+  for (size_t n = 0; n < value_depth; n++)
+    forward(&value_stack[n]);
+  for (size_t n = 0; n < binding_depth; n++)
+    forward(&binding_stack[n].saved);
+  forward_expansions();
 
-  size_t old_store_size = store_size;
-  allocate_store(old_store_size * 2);
+  for (size_t n = 0; n < nremembered; n++) {
+    obj_t obj = remembered[n];
+    if (symp(obj))
+      forward(&as_sym(obj)->val);
+    else if (consp(obj)) {
+      forward(&as_cons(obj)->car);
+      forward(&as_cons(obj)->cdr);
+    } else if (vectorp(obj)) {
+      vector_t *vec = as_vector(obj);
+      for (size_t i = 0; i < vec->len; i++)
+	forward(&vec->slots[i]);
+    } else if (funcp(obj))
+      forward_func(as_func(obj));
+  }
+  nremembered = 0;
+
+  while (npromoted) {
+    cons_t *cell = promoted[--npromoted];
+    forward(&cell->car);
+    forward(&cell->cdr);
+  }
 
-  if (!free_store) die();
+#ifdef GC_STRESS
+  // Make any stale pointer into the nursery fail loudly.
+  memset(nursery_start, 0xa5, sizeof(cons_t) * NURSERY_SIZE);
+#endif
+  nursery_next = nursery_start;
 
-  mark_used(old_store_size);
-  return &free_store[old_store_size];
+  gc_stats.minor_collections++;
+  gc_stats.cells_reclaimed += young - (store_used - used);
+  if (store_used > gc_stats.peak_store_used)
+    gc_stats.peak_store_used = store_used;
+
+  make_room_for_nursery();
+  unprotect(2);
+  end_pause();
 }
 
 
-obj_t
-cons(obj_t car, obj_t cdr) {
+// Run a full collection right now, returning the number of live cells.
+size_t
+collect_garbage() {
+  obj_t none = nil;
+  collect_nursery(&none, &none);
+  return garbage_collect();
+}
 
-  cons_t *cons = find_next_free_cons();
 
-  if (!cons) {
-    cons = garbage_collect_and_find();
+// Every cons ever made, counting those in the nursery now.
+size_t
+conses_made() {
+  return nursery_conses + (nursery_next - nursery_start);
+}
 
-    if (!cons) {
-      cons = expand_store_and_find();
-    }
+// The cons store never shrinks, so its size is also its peak.
+size_t
+read_gc_stats(gc_stat_t *stats) {
+  gc_stat_t all[NGC_STATS] = {
+    {"conses", conses_made()},
+    {"words-scanned", gc_stats.words_scanned},
+    {"minor-collections", gc_stats.minor_collections},
+    {"major-collections", gc_stats.major_collections},
+    {"cells-reclaimed", gc_stats.cells_reclaimed},
+    {"pauses", gc_stats.pauses},
+    {"pause-ns", gc_stats.pause_ns},
+    {"max-pause-ns", gc_stats.max_pause_ns},
+    {"last-pause-ns", gc_stats.last_pause_ns},
+    {"store-cells", store_size},
+    {"store-used", store_used},
+    {"peak-store-used", gc_stats.peak_store_used},
+    {"funcs", gc_stats.funcs_made},
+    {"syms", gc_stats.syms_made},
+  };
+  memcpy(stats, all, sizeof(all));
+  return NGC_STATS;
+}
+
+obj_t
+cons(obj_t car, obj_t cdr) {
+
+#ifdef GC_STRESS
+  // Build with -DGC_STRESS to empty the nursery every few allocations,
+  //  at varying intervals so that both fresh and slightly older cells
+  //  get moved, which turns any missing protect() into a failure.
+  static size_t countdown = 0;
+  if (!countdown--) {
+    countdown = (size_t)(nursery_next - nursery_start) * 7 % 61;
+    collect_nursery(&car, &cdr);
   }
+#endif
+  if (nursery_next == nursery_end)
+    collect_nursery(&car, &cdr);
 
+  cons_t *cons = nursery_next++;
   cons->car = car;
   cons->cdr = cdr;
   return make_cons(cons);
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include "lisp.h"
+#include "bytecode.h"
+
+// The expansion of a macro call is cached, keyed by the argument list
+//  of the call and the macro, so each call site is expanded once per
+//  definition of the macro; setting its name to another macro simply
+//  stops the old entries from matching.  Only argument lists that
+//  have left the nursery are cached, since only their addresses are
+//  fixed.  An entry is dropped by the first full collection after its
+//  call site or its macro can no longer be reached.
+typedef struct expansion {
+  cons_t *site;
+  func_t *macro;
+  obj_t expansion;
+} expansion_t;
+
+expansion_t *expansions = NULL;
+size_t expansions_size = 0;
+size_t expansions_count = 0;
+
+
+size_t
+expansion_slot(cons_t *site, func_t *macro) {
+  size_t mask = expansions_size - 1;
+  size_t key = (uintptr_t)site >> 4 ^ (uintptr_t)macro >> 3;
+  size_t idx = key * 0x9e3779b97f4a7c15 >> 7 & mask;
+  while (expansions[idx].site
+	 && (expansions[idx].site != site || expansions[idx].macro != macro))
+    idx = (idx + 1) & mask;
+  return idx;
+}
+
+void
+rehash_expansions(size_t nslots, bool drop_unmarked) {
+  expansion_t *old = expansions;
+  size_t old_size = expansions_size;
+
+  expansions = calloc(nslots, sizeof(expansion_t));
+  if (!expansions) die();
+  expansions_size = nslots;
+  expansions_count = 0;
+
+  for (size_t n = 0; n < old_size; n++) {
+    expansion_t *e = &old[n];
+    if (!e->site) continue;
+    if (drop_unmarked && !(cons_marked(e->site) && func_marked(e->macro)))
+      continue;
+    expansions[expansion_slot(e->site, e->macro)] = *e;
+    expansions_count++;
+  }
+  free(old);
+}
+
+obj_t
+expand_macro(func_t *macro, obj_t args) {
+  bool cacheable = consp(args) && !youngp(args);
+  if (tracing) trace_expansion(macro);
+
+  if (cacheable && expansions_count) {
+    expansion_t *e = &expansions[expansion_slot(as_cons(args), macro)];
+    if (e->site) return e->expansion;
+  }
+
+  push_frame(macro, nil);
+  obj_t expansion = call_lambda(macro, args);
+  pop_frame();
+
+  if (cacheable) {
+    if (2 * (expansions_count + 1) > expansions_size)
+      rehash_expansions(expansions_size? expansions_size * 2 : 256, false);
+    expansions[expansion_slot(as_cons(args), macro)] =
+      (expansion_t){as_cons(args), macro, expansion};
+    expansions_count++;
+  }
+  return expansion;
+}
+
+
+// Cached expansions are usually young, so every minor collection
+//  treats them as roots.
+void
+forward_expansions() {
+  for (size_t n = 0; n < expansions_size; n++)
+    if (expansions[n].site)
+      forward(&expansions[n].expansion);
+}
+
+// Whether a cached expansion is marked already, or needs no marking.
+bool
+expansion_marked(obj_t val) {
+  switch (gettype(val)) {
+  case TYPE_CONS:
+    return cons_marked(as_cons(val));
+  case TYPE_FUNC:
+    return func_marked(as_func(val));
+  case TYPE_STRING:
+    return as_string(val)->head.marked;
+  case TYPE_VECTOR:
+    return as_vector(val)->head.marked;
+  case TYPE_BIGNUM:
+    return as_bignum(val)->head.marked;
+  case TYPE_TABLE:
+    return as_table(val)->head.marked;
+  default:
+    return true;
+  }
+}
+
+// Marks the expansions whose call site and macro are both marked,
+//  returning whether that marked anything new.  Since an expansion
+//  can contain further call sites, this is repeated until it doesn't.
+bool
+mark_expansions() {
+  bool marked_more = false;
+  for (size_t n = 0; n < expansions_size; n++) {
+    expansion_t *e = &expansions[n];
+    if (!e->site || !cons_marked(e->site) || !func_marked(e->macro))
+      continue;
+    if (!expansion_marked(e->expansion)) {
+      mark_list(e->expansion);
+      marked_more = true;
+    }
+  }
+  return marked_more;
+}
+
+void
+sweep_expansions() {
+  if (expansions)
+    rehash_expansions(expansions_size, true);
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "lisp.h"
+#include "bytecode.h"
+
+// Function objects live in a slab of their own next to the cons
+//  store, with the same kind of used and mark bitmaps, and are swept
+//  along with it.
+#define INITIAL_FUNC_STORE_SIZE 1024
+#define MAX_FUNC_STORE_SIZE ((size_t)1 << 24)
+#define FUNC_ENTRY_BITS (CHAR_BIT * sizeof(*func_used))
+
+func_t *func_store = NULL;
+size_t *func_used = NULL;
+size_t *func_marks = NULL;
+size_t func_store_size = 0;
+size_t func_cursor = 0;
+size_t funcs_used = 0;
+
+// An interpreted function captures nothing, so any two made from the
+//  same lambda or mu source are interchangeable.  Each source gets
+//  one function object, found through this open-addressed table.  So
+//  does a lexical function made by the lambda* special form, which has
+//  nothing to capture; closures made by compiled code aren't interned.
+//  Only sources that have left the nursery are interned, since only
+//  their addresses are fixed; the table is weak, and is rebuilt from
+//  the survivors after every full collection.
+func_t **func_cache = NULL;
+size_t func_cache_size = 0;
+size_t func_cache_count = 0;
+
+
+void
+grow_func_store() {
+  if (!func_store) {
+    func_store = reserve(sizeof(func_t) * MAX_FUNC_STORE_SIZE);
+    func_used = reserve(MAX_FUNC_STORE_SIZE / CHAR_BIT);
+    func_marks = reserve(MAX_FUNC_STORE_SIZE / CHAR_BIT);
+  }
+  size_t nfuncs = func_store_size?
+    func_store_size * 2 : INITIAL_FUNC_STORE_SIZE;
+  if (nfuncs > MAX_FUNC_STORE_SIZE) {
+    fputs("* OUT OF FUNCTION STORE\n", stderr);
+    abort();
+  }
+  func_store_size = nfuncs;
+}
+
+func_t *
+find_next_free_func() {
+  size_t nentries = func_store_size / FUNC_ENTRY_BITS;
+  for (size_t entry = func_cursor; entry < nentries; entry++) {
+    size_t free_bits = ~func_used[entry];
+    if (free_bits) {
+      size_t bit = __builtin_ctzl(free_bits);
+      func_used[entry] |= (size_t)1 << bit;
+      func_cursor = entry;
+      funcs_used++;
+      return &func_store[entry*FUNC_ENTRY_BITS + bit];
+    }
+  }
+  func_cursor = nentries;
+  return NULL;
+}
+
+// Returns an unfilled function object.  This may collect, so the
+//  caller must protect anything it's holding.
+func_t *
+alloc_func() {
+  func_t *ret = find_next_free_func();
+  gc_stats.funcs_made++;
+  if (!ret) {
+    if (func_store_size) collect_garbage();
+    if (funcs_used > func_store_size / 2
+	|| !(ret = find_next_free_func())) {
+      grow_func_store();
+      ret = find_next_free_func();
+    }
+  }
+  return ret;
+}
+
+bool
+func_test_and_mark(func_t *func) {
+  size_t idx = func - func_store;
+  size_t entry = idx / FUNC_ENTRY_BITS;
+  size_t bit = (size_t)1 << (idx % FUNC_ENTRY_BITS);
+  if (func_marks[entry] & bit) return true;
+  func_marks[entry] |= bit;
+  return false;
+}
+
+void
+clear_func_marks() {
+  memset(func_marks, 0, func_store_size / CHAR_BIT);
+}
+
+
+size_t
+func_cache_slot(funcptr_t f) {
+  size_t mask = func_cache_size - 1;
+  size_t idx = ((uintptr_t)f.tag >> 4) * 0x9e3779b97f4a7c15 >> 7 & mask;
+  while (func_cache[idx] && func_cache[idx]->f.tag != f.tag)
+    idx = (idx + 1) & mask;
+  return idx;
+}
+
+bool
+func_marked(func_t *func) {
+  size_t idx = func - func_store;
+  return func_marks[idx / FUNC_ENTRY_BITS]
+    & (size_t)1 << (idx % FUNC_ENTRY_BITS);
+}
+
+void
+rehash_func_cache(size_t nslots, bool drop_unmarked) {
+  func_t **old = func_cache;
+  size_t old_size = func_cache_size;
+
+  func_cache = calloc(nslots, sizeof(func_t*));
+  if (!func_cache) die();
+  func_cache_size = nslots;
+  func_cache_count = 0;
+
+  for (size_t n = 0; n < old_size; n++) {
+    func_t *func = old[n];
+    if (func && !(drop_unmarked && !func_marked(func))) {
+      func_cache[func_cache_slot(func->f)] = func;
+      func_cache_count++;
+    }
+  }
+  free(old);
+}
+
+// Frees every function object that wasn't marked, along with its
+//  bytecode, and forgets any interned ones among them.
+void
+sweep_funcs() {
+  size_t nentries = func_store_size / FUNC_ENTRY_BITS;
+  funcs_used = 0;
+  for (size_t entry = 0; entry < nentries; entry++) {
+    size_t dead = func_used[entry] & ~func_marks[entry];
+    while (dead) {
+      func_t *func = &func_store[entry*FUNC_ENTRY_BITS + __builtin_ctzl(dead)];
+      if (has_bytecode(func) && !closurep(func))
+	free_bytecode(func->code);
+      func->code = NULL;
+      dead &= dead - 1;
+    }
+    func_used[entry] = func_marks[entry];
+    funcs_used += __builtin_popcountl(func_used[entry]);
+  }
+  func_cursor = 0;
+
+  if (func_cache)
+    rehash_func_cache(func_cache_size, true);
+}
+
+
+// Reads the arity of an interpreted function or macro off its
+//  parameter list.  Anything other than a name in it is destructured
+//  from a single argument.
+void
+count_params(func_t *f, obj_t params) {
+  bool plain = true;
+  uint32_t n = 0;
+  for (; consp(params); params = cdr(params), n++)
+    if (!symp(car(params)) || nullp(car(params)))
+      plain = false;
+  f->min_args = n;
+  f->max_args = nullp(params)? n : ANY_ARGS;
+  f->plain_params = plain && symp(params);
+}
+
+// Makes a new function object for an interpreted function or macro
+//  with the given source.  The parameters of a lexical function can
+//  only be names.
+func_t *
+make_interp_func(enum ftype type, obj_t source, bool lexical) {
+  protect(&source);
+  func_t *ret = alloc_func();
+  unprotect(1);
+  *ret = (func_t){type == FTYPE_MACRO?
+    make_macro(as_cons(source)) : make_interp(as_cons(source))};
+  write_barrier(make_func(ret), source);
+  count_params(ret, car(source));
+  ret->lexical = lexical;
+  ret->env = nil;
+  if (lexical && !ret->plain_params)
+    error(E_INVALID_NAME, car(source));
+  return ret;
+}
+
+// Returns the function object for an interpreted function or macro
+//  with the given source.  A source has one entry in the table, which
+//  is left to whichever kind of function was made from it first.
+func_t *
+intern_func(enum ftype type, obj_t source, bool lexical) {
+  bool internable = !youngp(source);
+  funcptr_t f = type == FTYPE_MACRO?
+    make_macro(as_cons(source)) : make_interp(as_cons(source));
+
+  if (internable && func_cache_count) {
+    func_t *found = func_cache[func_cache_slot(f)];
+    if (found && found->lexical == lexical) return found;
+  }
+
+  func_t *ret = make_interp_func(type, source, lexical);
+  if (internable) {
+    if (2 * (func_cache_count + 1) > func_cache_size)
+      rehash_func_cache(func_cache_size? func_cache_size * 2 : 256, false);
+    size_t slot = func_cache_slot(ret->f);
+    if (!func_cache[slot]) {
+      func_cache[slot] = ret;
+      func_cache_count++;
+    }
+  }
+  return ret;
+}
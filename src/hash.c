@@ -5,123 +5,255 @@
 #include <stdio.h>
 #include <assert.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// djb2, with a final mix so that the low bits used for the control
+//  bytes and the high bits used to pick a group are both well spread.
 hash_t
 hash(const char *str) {
   if (!str) return 0;
 
-  hash_t hash = 5381;
-  hash_t c;
-  while ((c = *str++))
-    hash = hash*33 + c;
-  return hash;
+  hash_t hash = HASH_SEED;
+  while (*str)
+    hash = hash_step(hash, *str++);
+  return hash_mix(hash);
+}
+
+
+// Control bytes.  Full slots hold h2() of their hash, which never has
+//  the top bit set; both markers do.
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xfe
+
+static inline uint8_t h2(hash_t h) {
+  return h & 0x7f;}
+static inline size_t h1(hash_t h) {
+  return h >> 7;}
+
+// A bitmask of the slots in a group whose control byte is b.
+static inline unsigned
+group_match(const uint8_t *ctrl, uint8_t b) {
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(b)));
+#else
+  unsigned mask = 0;
+  for (int n = 0; n < SYMT_GROUP_SIZE; n++)
+    mask |= (unsigned)(ctrl[n] == b) << n;
+  return mask;
+#endif
+}
+
+// A bitmask of the slots in a group that are empty or deleted.
+static inline unsigned
+group_match_free(const uint8_t *ctrl) {
+#ifdef __SSE2__
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+  unsigned mask = 0;
+  for (int n = 0; n < SYMT_GROUP_SIZE; n++)
+    mask |= (unsigned)(ctrl[n] >> 7) << n;
+  return mask;
+#endif
 }
 
 
 void
 symt_print_stats(struct symt *d) {
-  
-  size_t nempty = 0;
-  size_t ncolls = 0;
-  for (size_t i = 0; i < d->nitems; i++) {
-    struct symtentry *it = d->table[i];
-    if (!it) nempty++;
-    else if (it->next) {
-      printf("%s collides with ", it->key);
-      struct symtentry *in = it;
-      while ((in = in->next)) {
-	if (!in->next) {
-	  if (in == it->next) printf("%s.\n", in->key);
-	  else printf("and %s.\n", in->key);
-	} else printf("%s ", in->key);
-	ncolls++;
-      }
+  size_t ngroups = d->nslots / SYMT_GROUP_SIZE;
+  size_t nfull = 0, probes = 0;
+  for (size_t g = 0; g < ngroups; g++)
+    if (!group_match(&d->ctrl[g * SYMT_GROUP_SIZE], CTRL_EMPTY))
+      nfull++;
+  for (size_t n = 0; n < d->nslots; n++) {
+    sym_t *sym = d->slots[n];
+    if (!sym) continue;
+    size_t g = h1(sym->hash) & (ngroups - 1);
+    for (size_t step = 1; g != n / SYMT_GROUP_SIZE; step++) {
+      g = (g + step) & (ngroups - 1);
+      probes++;
     }
   }
-  printf("There were %zu collisions and %zu empties.\n", ncolls, nempty);
+  printf("%zu entries in %zu slots, %zu deleted; %zu of %zu groups full, "
+	 "%zu extra groups probed.\n", d->nitems, d->nslots, d->ndeleted,
+	 nfull, ngroups, probes);
 }
 
 
+// Names are copied into this arena when they're first added, and
+//  live as long as their symbols, which is forever.
+#define NAME_ARENA_SIZE ((size_t)1 << 30)
+char *name_arena = NULL;
+size_t name_arena_used = 0;
+
+key_t
+copy_name(key_t k, size_t len) {
+  if (!name_arena)
+    name_arena = reserve(NAME_ARENA_SIZE);
+
+  if (len + 1 > NAME_ARENA_SIZE - name_arena_used) {
+    fputs("* OUT OF NAME ARENA\n", stderr);
+    abort();
+  }
+  char *ret = memcpy(&name_arena[name_arena_used], k, len);
+  ret[len] = 0;
+  name_arena_used += len + 1;
+  return ret;
+}
+
+
+void
+symt_alloc_slots(struct symt *d, size_t nslots) {
+  d->nslots = nslots;
+  d->nitems = 0;
+  d->ndeleted = 0;
+  d->ctrl = malloc(nslots);
+  d->slots = calloc(nslots, sizeof(sym_t*));
+  if (!d->ctrl || !d->slots) die();
+  memset(d->ctrl, CTRL_EMPTY, nslots);
+}
 
 struct symt *
-symt_create(size_t nitems) {
-  assert((nitems & (nitems - 1)) == 0);
+symt_create(size_t nslots) {
+  assert((nslots & (nslots - 1)) == 0);
+  if (nslots < SYMT_GROUP_SIZE) nslots = SYMT_GROUP_SIZE;
 
-  struct symt *ret = malloc(sizeof(struct symt)
-			    + sizeof(sym_t*[nitems]));
+  struct symt *ret = malloc(sizeof(struct symt));
   if (!ret) die();
-
-  ret->nitems = nitems;
-  memset(&ret->table, 0, sizeof(sym_t*[nitems]));
+  symt_alloc_slots(ret, nslots);
   return ret;
 }
 
+// Returns the slot holding a key, or -1.  Groups are probed in
+//  triangular order, which visits every one of them since there are
+//  a power of two.
+size_t
+symt_find_slot(struct symt *d, key_t k, size_t len, hash_t h) {
+  size_t mask = d->nslots / SYMT_GROUP_SIZE - 1;
+  size_t g = h1(h) & mask;
 
-bool
-symt_match(key_t k, hash_t h, sym_t *d) {
-  if (!h) h = hash(k);
-  return d && h == d->hash && !strcmp(k, d->key);
+  for (size_t step = 1;; step++) {
+    const uint8_t *ctrl = &d->ctrl[g * SYMT_GROUP_SIZE];
+    for (unsigned m = group_match(ctrl, h2(h)); m; m &= m - 1) {
+      size_t idx = g * SYMT_GROUP_SIZE + __builtin_ctz(m);
+      sym_t *sym = d->slots[idx];
+      if (sym->hash == h && !strncmp(sym->key, k, len) && !sym->key[len])
+	return idx;
+    }
+    if (group_match(ctrl, CTRL_EMPTY))
+      return -1;
+    g = (g + step) & mask;
+  }
 }
 
-struct symtentry **
-symt_find_ll(struct symt *d, key_t k) {
-  assert(d);
+sym_t *
+symt_find_hashed(struct symt *d, key_t k, size_t len, hash_t h) {
+  size_t idx = symt_find_slot(d, k, len, h);
+  return idx == (size_t)-1? NULL : d->slots[idx];
+}
 
-  hash_t h = hash(k);
-  size_t idx = h & (d->nitems - 1);
+// Puts an entry into the first free slot along its probe sequence.
+void
+symt_place(struct symt *d, sym_t *sym) {
+  size_t mask = d->nslots / SYMT_GROUP_SIZE - 1;
+  size_t g = h1(sym->hash) & mask;
 
-  struct symtentry **ret = &d->table[idx];
-  while (*ret && !symt_match(k, h, *ret))
-    ret = &(*ret)->next;
+  for (size_t step = 1;; step++) {
+    unsigned m = group_match_free(&d->ctrl[g * SYMT_GROUP_SIZE]);
+    if (m) {
+      size_t idx = g * SYMT_GROUP_SIZE + __builtin_ctz(m);
+      if (d->ctrl[idx] == CTRL_DELETED) d->ndeleted--;
+      d->ctrl[idx] = h2(sym->hash);
+      d->slots[idx] = sym;
+      d->nitems++;
+      return;
+    }
+    g = (g + step) & mask;
+  }
+}
 
-  return ret;
+// Rebuilds the table with the given number of slots, which also
+//  clears out any deleted ones.
+void
+symt_rehash(struct symt *d, size_t nslots) {
+  uint8_t *old_ctrl = d->ctrl;
+  sym_t **old_slots = d->slots;
+  size_t old_size = d->nslots;
+
+  symt_alloc_slots(d, nslots);
+  for (size_t n = 0; n < old_size; n++)
+    if (old_slots[n])
+      symt_place(d, old_slots[n]);
+
+  free(old_ctrl);
+  free(old_slots);
 }
 
 sym_t *
-symt_add_at(sym_t **place, key_t k, obj_t val) {
-  assert(place);
+symt_add_hashed(struct symt *d, key_t k, size_t len, hash_t h, obj_t val) {
+  // Keep at least an eighth of the slots empty, so that every probe
+  //  sequence ends; double if the live entries alone are over half.
+  if ((d->nitems + d->ndeleted + 1) * 8 > d->nslots * 7)
+    symt_rehash(d, (d->nitems + 1) * 2 > d->nslots?
+		d->nslots * 2 : d->nslots);
 
   sym_t *ret = malloc(sizeof(*ret));
   if (!ret) die();
 
-  hash_t h = hash(k);
   ret->hash = h;
-  ret->key = k;
+  ret->key = copy_name(k, len);
   ret->val = val;
-  ret->next = *place;
-  return *place = ret;
+  ret->flags = 0;
+  symt_place(d, ret);
+  return ret;
 }
 
 sym_t *
 symt_push(struct symt *d, key_t k, obj_t val) {
-  sym_t **it = symt_find_ll(d,k);
-  return symt_add_at(it, k, val);
+  size_t len = strlen(k);
+  hash_t h = hash(k);
+  sym_t *it = symt_find_hashed(d, k, len, h);
+  return it? it : symt_add_hashed(d, k, len, h, val);
 }
 
 obj_t
 symt_rplac(struct symt *d, key_t k, obj_t val) {
-  sym_t **it = symt_find_ll(d,k);
-  if (*it) {
-    obj_t ret = (*it)->val;
-    (*it)->val = val;
+  size_t len = strlen(k);
+  hash_t h = hash(k);
+  sym_t *it = symt_find_hashed(d, k, len, h);
+  if (it) {
+    obj_t ret = it->val;
+    it->val = val;
     return ret;
   } else {
-    symt_add_at(it, k, val);
+    symt_add_hashed(d, k, len, h, val);
     return nil;
   }
 }
 
 sym_t *
 symt_find(struct symt *d, key_t k) {
-  return *symt_find_ll(d,k);
+  return symt_find_hashed(d, k, strlen(k), hash(k));
 }
 
+// A slot in a group that still has an empty slot can be emptied too,
+//  since any probe that got this far stops in this group anyway.
 sym_t *
 symt_pop(struct symt *d, key_t k) {
-  sym_t **it = symt_find_ll(d, k);
+  size_t idx = symt_find_slot(d, k, strlen(k), hash(k));
+  if (idx == (size_t)-1) return NULL;
 
-  sym_t *ret = *it;
-  if (ret)
-    *it = ret->next;
+  sym_t *ret = d->slots[idx];
+  const uint8_t *group = &d->ctrl[idx / SYMT_GROUP_SIZE * SYMT_GROUP_SIZE];
+  if (group_match(group, CTRL_EMPTY))
+    d->ctrl[idx] = CTRL_EMPTY;
+  else {
+    d->ctrl[idx] = CTRL_DELETED;
+    d->ndeleted++;
+  }
+  d->slots[idx] = NULL;
+  d->nitems--;
   return ret;
 }
-
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lisp.h"
+#include "hash.h"
+#include "builtins.h"
+#include "image.h"
+
+// The state of the stores, which only an image needs to get at.
+extern cons_t *free_store;
+extern size_t *free_list;
+extern size_t store_size, store_used, bump_next, bump_limit;
+void allocate_store(size_t ncells);
+extern func_t *func_store;
+extern size_t *func_used;
+extern size_t func_store_size, funcs_used, func_cursor;
+void grow_func_store(void);
+extern object_t **objects;
+extern size_t nobjects;
+extern symt_t *symtable;
+void symt_place(symt_t *d, sym_t *sym);
+
+#define IMAGE_MAGIC "LLIMAGE"
+#define IMAGE_VERSION 1
+
+// Sections that are mapped start on a boundary at least as coarse as
+//  any page size we're likely to meet.
+#define IMAGE_ALIGN ((size_t)1 << 16)
+
+// The file starts with this, and each section is at the offset given.
+//  An object in the image is its index shifted up past the tag: the
+//  index of a cell or function in its store, of a symbol among the
+//  symbols, or of an object among the objects.  A function's own
+//  pointer is an index into the cons store for an interpreted one, or
+//  else the number of the builtin.  A symbol's key is the offset of
+//  its name among the names.
+typedef struct image_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t tag_bits;
+  uint64_t signature;
+  uint32_t cons_size, func_size, sym_size;
+  uint64_t ncells, nfuncs, nsyms, nobjects, names_size;
+  uint64_t cells_at, cell_bits_at, funcs_at, func_bits_at;
+  uint64_t syms_at, names_at, objects_at, end;
+} image_header_t;
+
+static inline size_t
+align_to(size_t at, size_t alignment) {
+  return (at + alignment - 1) & ~(alignment - 1);
+}
+
+static inline obj_t
+make_index(enum type type, size_t idx) {
+  return (obj_t)((uintptr_t)idx << TAG_BITS | type);
+}
+
+static inline size_t
+index_of(obj_t obj) {
+  return obj._bits >> TAG_BITS;
+}
+
+static inline bool
+bit_set(const size_t *bits, size_t n) {
+  return bits[n / (8 * sizeof(size_t))] >> n % (8 * sizeof(size_t)) & 1;
+}
+
+static const char padding[sizeof(obj_t)];
+
+
+// Dumping.  Symbols and objects are numbered by their place in sorted
+//  copies of the symbol table and object list.
+
+sym_t **dump_syms;
+size_t ndump_syms;
+object_t **dump_objects;
+
+int
+compare_ptrs(const void *a, const void *b) {
+  uintptr_t x = *(uintptr_t*)a, y = *(uintptr_t*)b;
+  return (x > y) - (x < y);
+}
+
+size_t
+find_ptr(void *ptr, void *sorted, size_t n) {
+  void **found = bsearch(&ptr, sorted, n, sizeof(void*), compare_ptrs);
+  return found - (void**)sorted;
+}
+
+obj_t
+encode(obj_t obj) {
+  switch (gettype(obj)) {
+  case TYPE_MINT:
+    return obj;
+  case TYPE_CONS:
+    return make_index(TYPE_CONS, as_cons(obj) - free_store);
+  case TYPE_SYM:
+    return make_index(TYPE_SYM,
+		      find_ptr(as_sym(obj), dump_syms, ndump_syms));
+  case TYPE_FUNC:
+    return make_index(TYPE_FUNC, as_func(obj) - func_store);
+  default:
+    return make_index(gettype(obj), find_ptr((void*)(obj._bits & ~TAG_MASK),
+					     dump_objects, nobjects));
+  }
+}
+
+// Every table has its entries finished moving before anything is
+//  written, since its new vector may come before it in the dump, and
+//  the emptied old vectors are then collected rather than dumped.
+bool
+dump_image(const char *path) {
+  for (size_t n = 0; n < nobjects; n++)
+    if (objects[n]->type == TYPE_TABLE)
+      move_entries((table_t*)objects[n], SIZE_MAX);
+  collect_garbage();
+
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    fprintf(stderr, "* CAN'T WRITE IMAGE %s\n", path);
+    return false;
+  }
+
+  dump_syms = malloc(sizeof(sym_t*) * symtable->nitems);
+  dump_objects = malloc(sizeof(object_t*) * (nobjects + 1));
+  if (!dump_syms || !dump_objects) die();
+  ndump_syms = 0;
+  size_t names_size = 0;
+  for (size_t n = 0; n < symtable->nslots; n++)
+    if (symtable->slots[n]) {
+      dump_syms[ndump_syms++] = symtable->slots[n];
+      names_size += strlen(symtable->slots[n]->key) + 1;
+    }
+  qsort(dump_syms, ndump_syms, sizeof(sym_t*), compare_ptrs);
+  memcpy(dump_objects, objects, sizeof(object_t*) * nobjects);
+  qsort(dump_objects, nobjects, sizeof(object_t*), compare_ptrs);
+
+  image_header_t h = {
+    .magic = IMAGE_MAGIC, .version = IMAGE_VERSION, .tag_bits = TAG_BITS,
+    .signature = builtins_signature(),
+    .cons_size = sizeof(cons_t), .func_size = sizeof(func_t),
+    .sym_size = sizeof(sym_t),
+    .ncells = store_size, .nfuncs = func_store_size, .nsyms = ndump_syms,
+    .nobjects = nobjects, .names_size = names_size,
+  };
+  h.cells_at = align_to(sizeof(h), IMAGE_ALIGN);
+  h.cell_bits_at = h.cells_at + sizeof(cons_t) * h.ncells;
+  h.funcs_at = align_to(h.cell_bits_at + h.ncells / 8, IMAGE_ALIGN);
+  h.func_bits_at = h.funcs_at + sizeof(func_t) * h.nfuncs;
+  h.syms_at = align_to(h.func_bits_at + h.nfuncs / 8, IMAGE_ALIGN);
+  h.names_at = h.syms_at + sizeof(sym_t) * h.nsyms;
+  h.objects_at = align_to(h.names_at + h.names_size, sizeof(obj_t));
+  h.end = h.objects_at;
+  for (size_t n = 0; n < nobjects; n++)
+    h.end += align_to(objects[n]->size, sizeof(obj_t));
+  fwrite(&h, sizeof(h), 1, out);
+
+  fseek(out, h.cells_at, SEEK_SET);
+  for (size_t n = 0; n < store_size; n++) {
+    cons_t cell = {{0}, {0}};
+    if (bit_set(free_list, n))
+      cell = (cons_t){encode(free_store[n].car), encode(free_store[n].cdr)};
+    fwrite(&cell, sizeof(cell), 1, out);
+  }
+  fwrite(free_list, 1, h.ncells / 8, out);
+
+  fseek(out, h.funcs_at, SEEK_SET);
+  for (size_t n = 0; n < func_store_size; n++) {
+    func_t f = {{0}};
+    if (bit_set(func_used, n)) {
+      f = func_store[n];
+      enum ftype type = getftype(&f);
+      size_t idx = type == FTYPE_INTERP || type == FTYPE_MACRO?
+	(size_t)(as_interp(&f) - free_store) : builtin_number(&f);
+      f.f.tag = (intptr_t)idx << 2 | type;
+      f.code = NULL;
+      f.ncalls = 0;
+      if (f.lexical) f.env = encode(f.env);
+      f.fn1 = NULL;
+      f.fn2 = NULL;
+    }
+    fwrite(&f, sizeof(f), 1, out);
+  }
+  fwrite(func_used, 1, h.nfuncs / 8, out);
+
+  fseek(out, h.syms_at, SEEK_SET);
+  size_t name_at = 0;
+  for (size_t n = 0; n < ndump_syms; n++) {
+    sym_t sym = *dump_syms[n];
+    sym.key = (key_t)name_at;
+    sym.val = encode(sym.val);
+    name_at += strlen(dump_syms[n]->key) + 1;
+    fwrite(&sym, sizeof(sym), 1, out);
+  }
+  for (size_t n = 0; n < ndump_syms; n++)
+    fwrite(dump_syms[n]->key, 1, strlen(dump_syms[n]->key) + 1, out);
+  fwrite(padding, 1, h.objects_at - h.names_at - h.names_size, out);
+
+  // Of the objects, only vectors and tables hold anything that needs
+  //  encoding.  A table only has the one vector to hash again when
+  //  it's loaded.
+  for (size_t n = 0; n < nobjects; n++) {
+    object_t *obj = dump_objects[n];
+    if (obj->type == TYPE_VECTOR) {
+      vector_t *vec = (vector_t*)obj;
+      fwrite(vec, sizeof(vector_t), 1, out);
+      for (size_t i = 0; i < vec->len; i++) {
+	obj_t slot = encode(vec->slots[i]);
+	fwrite(&slot, sizeof(slot), 1, out);
+      }
+    } else if (obj->type == TYPE_TABLE) {
+      table_t tab = *(table_t*)obj;
+      tab.entries = encode(tab.entries);
+      tab.old = encode(nil);
+      tab.moved = 0;
+      fwrite(&tab, sizeof(tab), 1, out);
+    } else fwrite(obj, 1, obj->size, out);
+    fwrite(padding, 1, align_to(obj->size, sizeof(obj_t)) - obj->size, out);
+  }
+
+  bool ok = !ferror(out);
+  ok = !fclose(out) && ok;
+  free(dump_syms);
+  free(dump_objects);
+  if (!ok)
+    fprintf(stderr, "* CAN'T WRITE IMAGE %s\n", path);
+  return ok;
+}
+
+
+// Loading.  Everything is put in place first, so that the addresses
+//  indices refer to are all known, and then fixed up.
+
+sym_t *load_syms;
+object_t **load_objects;
+image_header_t *image;
+bool image_bad;
+
+// Anything out of range marks the image as bad, and is taken as nil.
+obj_t
+decode(obj_t obj) {
+  size_t idx = index_of(obj);
+  switch (gettype(obj)) {
+  case TYPE_MINT:
+    return obj;
+  case TYPE_CONS:
+    if (idx >= image->ncells) break;
+    return make_cons(&free_store[idx]);
+  case TYPE_SYM:
+    if (idx >= image->nsyms) break;
+    return make_sym(&load_syms[idx]);
+  case TYPE_FUNC:
+    if (idx >= image->nfuncs) break;
+    return make_func(&func_store[idx]);
+  default:
+    if (idx >= image->nobjects || load_objects[idx]->type != gettype(obj))
+      break;
+    return (obj_t)((uintptr_t)load_objects[idx] | gettype(obj));
+  }
+  image_bad = true;
+  return nil;
+}
+
+bool
+check_header(image_header_t *h, size_t size) {
+  return size >= sizeof(*h) && !memcmp(h->magic, IMAGE_MAGIC, 8)
+    && h->version == IMAGE_VERSION && h->tag_bits == TAG_BITS
+    && h->signature == builtins_signature()
+    && h->cons_size == sizeof(cons_t) && h->func_size == sizeof(func_t)
+    && h->sym_size == sizeof(sym_t) && h->end <= size
+    && h->cell_bits_at + h->ncells / 8 <= h->funcs_at
+    && h->func_bits_at + h->nfuncs / 8 <= h->syms_at
+    && h->names_at + h->names_size <= h->objects_at
+    && h->objects_at <= h->end
+    && (!h->names_size || !((char*)h)[h->names_at + h->names_size - 1]);
+}
+
+// The cons and function stores are mapped over their reservations, so
+//  only the pages that get touched are ever read in.  Symbols stay in
+//  the image, names and all; objects are copied out of it.
+bool
+load_image(const char *path) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st)) {
+    fprintf(stderr, "* CAN'T OPEN IMAGE %s\n", path);
+    return false;
+  }
+  char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		    fd, 0);
+  image = (image_header_t*)base;
+  if (base == MAP_FAILED || !check_header(image, st.st_size)) {
+    fprintf(stderr, "* BAD IMAGE %s\n", path);
+    close(fd);
+    return false;
+  }
+
+  allocate_store(image->ncells);
+  bump_next = bump_limit;
+  void *cells = mmap(free_store, sizeof(cons_t) * image->ncells,
+		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+		     fd, image->cells_at);
+  while (func_store_size < image->nfuncs)
+    grow_func_store();
+  void *funcs = mmap(func_store, sizeof(func_t) * image->nfuncs,
+		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+		     fd, image->funcs_at);
+  close(fd);
+  if (cells == MAP_FAILED || funcs == MAP_FAILED
+      || func_store_size != image->nfuncs) {
+    fprintf(stderr, "* CAN'T MAP IMAGE %s\n", path);
+    return false;
+  }
+  memcpy(free_list, base + image->cell_bits_at, image->ncells / 8);
+  memcpy(func_used, base + image->func_bits_at, image->nfuncs / 8);
+
+  load_syms = (sym_t*)(base + image->syms_at);
+  load_objects = malloc(sizeof(object_t*) * (image->nobjects + 1));
+  if (!load_objects) die();
+  size_t at = image->objects_at;
+  for (size_t n = 0; n < image->nobjects; n++) {
+    object_t *obj = (object_t*)(base + at);
+    if (at + sizeof(object_t) > image->end
+	|| obj->size < sizeof(object_t) || obj->size > image->end - at) {
+      fprintf(stderr, "* BAD IMAGE %s\n", path);
+      return false;
+    }
+    load_objects[n] = copy_object(obj);
+    at += align_to(obj->size, sizeof(obj_t));
+  }
+
+  image_bad = false;
+  store_used = 0;
+  for (size_t n = 0; n < image->ncells; n++)
+    if (bit_set(free_list, n)) {
+      free_store[n].car = decode(free_store[n].car);
+      free_store[n].cdr = decode(free_store[n].cdr);
+      store_used++;
+    }
+
+  funcs_used = 0;
+  func_cursor = 0;
+  for (size_t n = 0; n < image->nfuncs; n++)
+    if (bit_set(func_used, n)) {
+      func_t *f = &func_store[n];
+      enum ftype type = getftype(f);
+      size_t idx = (uintptr_t)f->f.tag >> 2;
+      if (type == FTYPE_INTERP || type == FTYPE_MACRO) {
+	if (idx >= image->ncells) image_bad = true;
+	else f->f = type == FTYPE_INTERP? make_interp(&free_store[idx])
+	       : make_macro(&free_store[idx]);
+      } else if (!init_builtin(f, type, idx))
+	image_bad = true;
+      if (f->lexical) f->env = decode(f->env);
+      funcs_used++;
+    }
+
+  for (size_t n = 0; n < image->nobjects; n++)
+    if (load_objects[n]->type == TYPE_VECTOR) {
+      vector_t *vec = (vector_t*)load_objects[n];
+      for (size_t i = 0; i < vec->len; i++)
+	vec->slots[i] = decode(vec->slots[i]);
+    } else if (load_objects[n]->type == TYPE_TABLE) {
+      table_t *tab = (table_t*)load_objects[n];
+      tab->entries = decode(tab->entries);
+      tab->old = decode(tab->old);
+    }
+
+  // Only once all the keys are there to be hashed.
+  for (size_t n = 0; n < image->nobjects && !image_bad; n++)
+    if (load_objects[n]->type == TYPE_TABLE) {
+      table_t *tab = (table_t*)load_objects[n];
+      if (!vectorp(tab->entries)) image_bad = true;
+      else rehash_table(tab);
+    }
+
+  // The table is made big enough that it won't have to grow.
+  size_t nslots = 128;
+  while (nslots < 2 * image->nsyms) nslots *= 2;
+  symtable = symt_create(nslots);
+  const char *names = base + image->names_at;
+  for (size_t n = 0; n < image->nsyms; n++) {
+    sym_t *sym = &load_syms[n];
+    if ((uintptr_t)sym->key >= image->names_size) {
+      image_bad = true;
+      break;
+    }
+    sym->key = names + (uintptr_t)sym->key;
+    sym->val = decode(sym->val);
+    symt_place(symtable, sym);
+  }
+
+  free(load_objects);
+  if (image_bad)
+    fprintf(stderr, "* BAD IMAGE %s\n", path);
+  return !image_bad;
+}
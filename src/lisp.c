@@ -1,12 +1,16 @@
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdbool.h>
 
 #include <setjmp.h>
 #include "lisp.h"
 #include "hash.h"
 #include "builtins.h"
+#include "bytecode.h"
+#include "read.h"
+#include "bignum.h"
+#include "image.h"
+#include "profile.h"
 
 // nil will be redefined in init code, but some of that code depends
 //  on nil having some (any) value; the mint 0 has been chosen arbitrarily
@@ -14,6 +18,15 @@ obj_t nil=(obj_t)0L, t;
 obj_t quote, quasiquote, unquote, unquote_splice;
 symt_t *symtable;
 
+// Dynamic bindings are shallow: the bound value goes straight into
+//  the symbol, and whatever it replaced is saved here until unbinding.
+#define BINDING_STACK_SIZE ((size_t)1 << 20)
+binding_t binding_stack[BINDING_STACK_SIZE];
+size_t binding_depth = 0;
+
+frame_t frame_stack[FRAME_STACK_SIZE];
+size_t frame_depth = 0;
+
 obj_t 
 car(obj_t cons) {
   if (gettype(cons) == TYPE_CONS)
@@ -30,14 +43,9 @@ cdr(obj_t cons) {
 
 obj_t 
 sym_value(sym_t *sym) {
-  obj_t val = sym->val;
-  if (consp(val))
-    return car(val);
-
-  if (nullp(val) && !nullp(make_sym(sym)))
+  if (sym->flags & SYM_UNBOUND)
     error(E_UNDECLARED, make_sym(sym));
-
-  return val;
+  return sym->val;
 }
 
 obj_t
@@ -49,25 +57,41 @@ sym_t *
 bind_sym(sym_t *sym, obj_t val) {
 
   // prevent assigning to nil or constants
-  if (nullp(make_sym(sym)) || !listp(sym->val))
+  if (sym->flags & SYM_CONSTANT)
     error(E_REDEFINE, make_sym(sym));
 
-  sym->val = cons(val, sym->val);
+  binding_stack[binding_depth++] = (binding_t){sym, sym->val, sym->flags};
+  sym->val = val;
+  sym->flags = (sym->flags & ~SYM_UNBOUND) | SYM_SPECIAL;
+  write_barrier(make_sym(sym), val);
   return sym;
 }
 
+// Undoes every binding made since the stack was at the given depth.
+void
+unbind_to(size_t depth) {
+  while (binding_depth > depth) {
+    binding_t *b = &binding_stack[--binding_depth];
+    b->sym->val = b->saved;
+    b->sym->flags = b->saved_flags;
+    write_barrier(make_sym(b->sym), b->saved);
+  }
+}
+
 sym_t *
-unbind_sym(sym_t *sym) {
-  if (consp(sym->val))
-    sym->val = cdr(sym->val);
+intern_hashed(key_t name, size_t len, hash_t h) {
+  sym_t *sym = symt_find_hashed(symtable, name, len, h);
+  if (!sym) {
+    sym = symt_add_hashed(symtable, name, len, h, nil);
+    sym->flags = SYM_UNBOUND;
+    gc_stats.syms_made++;
+  }
   return sym;
 }
 
 sym_t *
 intern_name(key_t name) {
-  sym_t **place = symt_find_ll(symtable, name);
-  if (!*place) symt_add_at(place, name, nil);
-  return *place;
+  return intern_hashed(name, strlen(name), hash(name));
 }
 
 sym_t *
@@ -79,6 +103,8 @@ sym_t *
 make_const(key_t name, obj_t val) {
   sym_t *ret = intern_name(name);
   ret->val = val;
+  ret->flags = SYM_CONSTANT;
+  write_barrier(make_sym(ret), val);
   return ret;
 }
 
@@ -86,76 +112,69 @@ sym_t *
 make_self_evaluating(key_t name) {
   sym_t *ret = intern_name(name);
   ret->val = make_sym(ret);
+  ret->flags = SYM_CONSTANT;
   return ret;
 }
 
-void
-unbind_list(obj_t names) {
+obj_t binderrobj;
+
+// Binds each symbol in a parameter list, which may be nested or
+//  dotted, to the matching part of args.  Nothing is allocated.
+error_t
+bind_pattern(obj_t names, obj_t args) {
   while (consp(names)) {
-    if (symp(car(names)))
-      unbind_sym(as_sym(car(names)));
+    if (!consp(args))
+      return E_FAILED_BIND;
+    error_t err = bind_pattern(car(names), car(args));
+    if (err) return err;
     names = cdr(names);
+    args = cdr(args);
   }
-  if (!nullp(names))
-    unbind_sym(as_sym(names));
-}
-
-obj_t
-eval_list(obj_t list) {
-  if (!consp(list))
-    return eval(list);
-  else
-    return cons(eval(car(list)), eval_list(cdr(list)));
-}
-
-obj_t binderrobj;
 
-// generates a binding list to be walked by bind_list
-error_t
-generate_binding_list(obj_t names, obj_t args, obj_t *out) {
   switch (gettype(names)) {
-  case TYPE_MINT:
-  case TYPE_FUNC:
-    binderrobj = names;
-    return E_INVALID_NAME;
   case TYPE_SYM:
-    if (nullp(names)) {
-      return nullp(args) ? E_ALL_OKAY : E_FAILED_BIND;}
-    *out = cons(cons(names, args), *out);
+    if (nullp(names))
+      return nullp(args) ? E_ALL_OKAY : E_FAILED_BIND;
+    bind_sym(as_sym(names), args);
     return E_ALL_OKAY;
-  case TYPE_CONS: {
-    if (!consp(args))
-      return E_FAILED_BIND;
-    error_t ret = generate_binding_list(car(names), car(args), out);
-    return ret? ret: generate_binding_list(cdr(names), cdr(args), out);
-  }}
+  default:
+    binderrobj = names;
+    return E_INVALID_NAME;
+  }
 }
 
 void
 bind_list(obj_t names, obj_t args) {
-  obj_t bindings = nil;
-  error_t err = generate_binding_list(names, args, &bindings);
+  size_t depth = binding_depth;
+  error_t err = bind_pattern(names, args);
 
-  if (err == E_FAILED_BIND) binderrobj = cons(names, args);
-  if (err) error(err, binderrobj);
-
-  while (!nullp(bindings)) {
-    obj_t name = car(car(bindings));
-    obj_t val = cdr(car(bindings));
-
-    bind_sym(as_sym(name), val);
-
-    bindings = cdr(bindings);
+  if (err) {
+    unbind_to(depth);
+    if (err == E_FAILED_BIND) binderrobj = cons(names, args);
+    error(err, binderrobj);
   }
 }
 
 
+// Compiles an interpreted function or macro once it's been called
+//  enough, or a lexical function straight away, and returns whether
+//  it has bytecode to run.
+bool
+ready_to_execute(func_t *f) {
+  if (!f->code && (f->lexical || ++f->ncalls >= COMPILE_THRESHOLD))
+    compile_function(f);
+  return has_bytecode(f);
+}
+
+// Runs the body of an interpreted function or macro whose parameters
+//  were bound from frame up on the binding stack.
 obj_t
-interpret_function(cons_t *lam, obj_t args) {
-  obj_t parlist = lam->car;
-  obj_t body = lam->cdr;
+run_body(func_t *f, size_t frame) {
+  if (ready_to_execute(f))
+    return execute(f, frame, value_depth);
 
-  bind_list(parlist, args);
+  obj_t body = as_interp(f)->cdr;
+  protect(&body);
 
   obj_t ret = nil;
   do {
@@ -163,27 +182,205 @@ interpret_function(cons_t *lam, obj_t args) {
     body = cdr(body);
   } while (consp(body));
 
-  unbind_list(parlist);
+  unprotect(1);
+  return ret;
+}
+
+// Pushes every element of an evaluated argument list onto the value
+//  stack, as when a builtin is applied to a list.
+void
+spread_values(obj_t args) {
+  while (consp(args)) {
+    if (value_depth == VALUE_STACK_SIZE)
+      error(E_WRONG_ARGCOUNT, args);
+    push_value(car(args));
+    args = cdr(args);
+  }
+}
+
+obj_t
+call_lambda(func_t *f, obj_t args) {
+  if (f->lexical) {
+    push_value(make_func(f));
+    size_t base = value_depth;
+    spread_values(args);
+    obj_t ret = call_lambda_values(f, base);
+    value_depth--;
+    return ret;
+  }
+
+  size_t depth = binding_depth;
+  bind_list(as_interp(f)->car, args);
+  obj_t ret = run_body(f, depth);
+  unbind_to(depth);
+  return ret;
+}
+
+// Gives sym a new value, reusing its binding if it has one from frame
+//  up: nothing can see the old value any more, which is what lets a
+//  tail call rebind its parameters without growing the stack.
+void
+rebind_sym(sym_t *sym, obj_t val, size_t frame) {
+  for (size_t n = frame; n < binding_depth; n++)
+    if (binding_stack[n].sym == sym) {
+      sym->val = val;
+      write_barrier(make_sym(sym), val);
+      return;
+    }
+  bind_sym(sym, val);
+}
+
+// Binds the parameters of f to the arguments from base up on the
+//  value stack, and pops them.  A plain list of names, possibly
+//  dotted, is bound straight from the stack when the arity matches;
+//  anything else gets its arguments as a list, and any error from
+//  binding them.
+void
+bind_values(func_t *f, size_t base, size_t frame) {
+  size_t argc = value_depth - base;
+  obj_t params = as_interp(f)->car;
+
+  if (!f->plain_params || argc < f->min_args || argc > f->max_args) {
+    obj_t args = list_from_args(argc, &value_stack[base]);
+    value_depth = base;
+    bind_list(as_interp(f)->car, args);
+    return;
+  }
+
+  size_t nnames = f->min_args;
+  obj_t names = params;
+  for (size_t n = 0; n < nnames; n++, names = as_cons(names)->cdr)
+    rebind_sym(as_sym(as_cons(names)->car), value_stack[base + n], frame);
+  if (!nullp(names))
+    rebind_sym(as_sym(names),
+	       list_from_args(argc - nnames, &value_stack[base + nnames]),
+	       frame);
+  value_depth = base;
+}
+
+// A lexical function can only be run as bytecode, which it only
+//  lacks while its own compiling calls it.
+obj_t
+call_lambda_values(func_t *f, size_t base) {
+  size_t depth = binding_depth;
+  if (f->lexical) {
+    if (!ready_to_execute(f))
+      error(E_NO_FUNCTION, make_func(f));
+    obj_t ret = execute(f, depth, base);
+    unbind_to(depth);
+    return ret;
+  }
 
+  bind_values(f, base, depth);
+  obj_t ret = run_body(f, depth);
+  unbind_to(depth);
   return ret;
 }
 
+// A rest parameter takes its arguments as a list, in its own slot.
+void
+enter_lexical(func_t *f, size_t stack) {
+  size_t base = stack + 1, argc = value_depth - base;
+  if (argc < f->min_args || argc > f->max_args)
+    error(E_WRONG_ARGCOUNT, make_mint(argc));
+  if (f->max_args == ANY_ARGS) {
+    obj_t rest = list_from_args(argc - f->min_args,
+				&value_stack[base + f->min_args]);
+    value_depth = base + f->min_args;
+    push_value(rest);
+  }
+  while (value_depth < base + f->code->nlocals)
+    push_value(nil);
+}
+
+// The arity of a builtin is checked here, once, so that builtins
+//  themselves needn't.
 obj_t
-funcall(obj_t it, obj_t args) {
+call_builtin(func_t *f, size_t base) {
+  size_t argc = value_depth - base;
+  obj_t *argv = &value_stack[base];
+  if (argc < f->min_args || argc > f->max_args)
+    error(E_WRONG_ARGCOUNT, make_mint(argc));
+
+  obj_t ret;
+  if (argc == 1 && f->fn1)
+    ret = f->fn1(argv[0]);
+  else if (argc == 2 && f->fn2)
+    ret = f->fn2(argv[0], argv[1]);
+  else ret = as_compiled(f)(argc, argv);
+  value_depth = base;
+  return ret;
+}
+
+// Calls a function on an already evaluated list of arguments.
+obj_t
+apply(obj_t fn, obj_t args) {
+  if (!funcp(fn)) error(E_NO_FUNCTION, fn);
+
+  func_t *f = as_func(fn);
+  obj_t ret;
+  switch (getftype(f)) {
+  case FTYPE_COMPILED: {
+    size_t base = value_depth;
+    spread_values(args);
+    push_frame(f, nil);
+    ret = call_builtin(f, base);
+    break;
+  } case FTYPE_INTERP:
+    push_frame(f, nil);
+    ret = call_lambda(f, args);
+    break;
+  default:
+    error(E_NO_FUNCTION, fn);
+    return nil;
+  }
+  pop_frame();
+  return ret;
+}
+
+// Calls a function on the unevaluated arguments of the form that
+//  called it.
+obj_t
+funcall(obj_t it, obj_t form) {
   if (!funcp(it)) error(E_NO_FUNCTION, it);
 
   func_t *f = as_func(it);
+  obj_t head = car(form), args = cdr(form);
+  obj_t ret;
   
   switch (getftype(f)) {
-  case FTYPE_COMPILED: {
-    return as_compiled(f)(eval_list(args));
-  } case FTYPE_INTERP:
-    return interpret_function(as_interp(f), eval_list(args));
-  case FTYPE_SPECIAL:
-    return as_compiled(f)(args);
-  case FTYPE_MACRO:
-    return eval(interpret_function(as_interp(f), args));
+  case FTYPE_COMPILED:
+  case FTYPE_INTERP: {
+    // A dotted tail is evaluated to a list of further arguments.  The
+    //  function is kept below them, which keeps a closure alive.
+    push_value(it);
+    size_t base = value_depth;
+    protect(&args);
+    while (consp(args)) {
+      push_value(eval(car(args)));
+      args = cdr(args);
+    }
+    if (!nullp(args))
+      spread_values(eval(args));
+    unprotect(1);
+    push_frame(f, symp(head)? head : nil);
+    if (getftype(f) == FTYPE_COMPILED)
+      ret = call_builtin(f, base);
+    else ret = call_lambda_values(f, base);
+    pop_frame();
+    value_depth--;
+    return ret;
   }
+  case FTYPE_SPECIAL:
+    return as_special(f)(args);
+  case FTYPE_MACRO: {
+    obj_t expansion = expand_macro(f, args);
+    protect(&expansion);
+    ret = eval(expansion);
+    break;
+  }}
+  unprotect(1);
+  return ret;
 }
 
 obj_t
@@ -193,20 +390,21 @@ eval(obj_t it) {
     return sym_value(as_sym(it));
   case TYPE_MINT:
   case TYPE_FUNC:
+  case TYPE_STRING:
+  case TYPE_VECTOR:
+  case TYPE_BIGNUM:
+  case TYPE_TABLE:
     return it;
-  case TYPE_CONS:
-    return funcall(eval(as_cons(it)->car), as_cons(it)->cdr);
-  }
-}
-
-bool stringp(obj_t str) {
-  while (consp(str)) {
-    if (!mintp(car(str)) || !isprint(as_mint(car(str))))
-      return false;
-    str = cdr(str);
-  }
-  if (!nullp(str)) return false;
-  return true;
+  case TYPE_CONS: {
+    protect(&it);
+    obj_t fn = eval(as_cons(it)->car);
+    protect(&fn);
+    obj_t ret = funcall(fn, it);
+    unprotect(2);
+    return ret;
+  }}
+  // Every type is handled above.
+  return nil;
 }
 
 obj_t
@@ -228,168 +426,168 @@ printy(obj_t arg) {
       printf("<special form>"); break;
     }
     break;
-  case TYPE_CONS:
-    if (stringp(arg)) {
-      putchar('"');
-      while (consp(arg)) {
-	if (mintp(car(arg)) && isprint(as_mint(car(arg))))
-	  putchar(as_mint(car(arg)));
-	arg = cdr(arg);
-      }
-      putchar('"');
-    } else {
-      putchar('(');
+  case TYPE_BIGNUM:
+    print_bignum(as_bignum(arg), stdout);
+    break;
+  case TYPE_STRING:
+    putchar('"');
+    fwrite(as_string(arg)->bytes, 1, as_string(arg)->len, stdout);
+    putchar('"');
+    break;
+  case TYPE_TABLE:
+    printf("<hash table>");
+    break;
+  case TYPE_VECTOR: {
+    vector_t *vec = as_vector(arg);
+    printf("#(");
+    for (size_t n = 0; n < vec->len; n++) {
+      if (n) putchar(' ');
+      printy(vec->slots[n]);
+    }
+    putchar(')');
+    break;
+  } case TYPE_CONS:
+    putchar('(');
+    printy(car(arg));
+    while (consp(arg = cdr(arg))) {
+      putchar(' ');
       printy(car(arg));
-      while (consp(arg = cdr(arg))) {
-	putchar(' ');
-	printy(car(arg));
-      }
-      if (!nullp(arg)) {
-	printf(" . ");
-	printy(arg);
-      }
-      putchar(')');
     }
+    if (!nullp(arg)) {
+      printf(" . ");
+      printy(arg);
+    }
+    putchar(')');
     break;
   }
   return nil;
 }
 
-obj_t read(FILE *in);
-
-obj_t
-read_cons(FILE *in) {
-  int c;
-  while (isspace(c = fgetc(in)));
-  if (c == ')') return nil;
-  if (c == '.') {
-    obj_t ret = read(in);
-    while (isspace(c = fgetc(in)));
-    if (c != ')')
-      error(E_READ_ERROR, nil);
-    return ret;
-  } else {
-    ungetc(c, in);
-    return cons(read(in), read_cons(in));
-  }
-}
+jmp_buf errhandler;
+obj_t errobj;
+obj_t toplevel;
 
-char *
-gets_until(FILE *in, bool(*pred)(char)) {
-  int c;
-  size_t size=8, len=0;
-  char *buf = malloc(size);
-
-  while ((c = fgetc(in)) != EOF && !pred(buf[len] = c))
-    if (++len == size) {
-      buf = realloc(buf, size *= 2);
-      if (!buf) return NULL;
-    }
-  buf[len] = 0;
-  if (c != EOF) ungetc(c, in);
-
-  return buf;
-}
+// Files are loaded one after another, autoload.lisp first if there is
+//  one and then any named on the command line, before the prompt.  An
+//  image already holds whatever was loaded when it was dumped, so
+//  autoload.lisp isn't loaded again on top of it.
+char **load_paths;
+int nloads, next_load = 0;
+reader_t *loading = NULL;
 
+// Opens the next file to load, returning false when there are none.
 bool
-is_terminating(char c) {
-  return c=='(' || c==')' || isspace(c);
-}
-
-obj_t
-read_mint(char *str) {
-  char *endptr = str;
-  mint_t x = strtol(str, &endptr, 0);
-  if (!*endptr) return make_mint(x);
-  else return nil;
+open_next_load() {
+  if (loading) close_reader(loading);
+  loading = NULL;
+  while (!loading && next_load < nloads) {
+    char *path = load_paths[next_load++];
+    loading = open_reader(path);
+    if (!loading && next_load > 1)
+      fprintf(stderr, "* CAN'T OPEN %s\n", path);
+  }
+  return loading;
 }
 
+// A form from a lexical file is run as the body of a lexical function
+//  of no arguments, so that the lambdas in it close over its lets.
 obj_t
-read_string(FILE *in) {
-  obj_t ret = cons(quote, nil);
-  obj_t ptr = ret;
-  int c;
-  bool backslashed = false;
-  while ((c = fgetc(in)) != EOF) {
-    if (!backslashed && c == '"') break;
-
-    if (c == '\\')
-      backslashed = true;
-    else
-      backslashed = false;
-
-    as_cons(ptr)->cdr = cons(make_mint(c), nil);
-    ptr = cdr(ptr);
-  }
+eval_lexical(obj_t form) {
+  obj_t fn = make_func(make_interp_func(FTYPE_INTERP,
+					cons(nil, cons(form, nil)), true));
+  protect(&fn);
+  push_frame(as_func(fn), nil);
+  obj_t ret = call_lambda(as_func(fn), nil);
+  pop_frame();
+  unprotect(1);
   return ret;
 }
 
-obj_t
-read(FILE *in) {
-  int c;
-
-  while (isspace(c = fgetc(in)));
-
-  switch (c) {
-  case EOF:
-    error(E_END_OF_FILE, nil);
-  case ')':
-    error(E_READ_ERROR, nil);
-  case '(':
-    return read_cons(in);
-  case '\'':
-    return cons(quote, read(in));
-  case '`':
-    return cons(quasiquote, read(in));
-  case ',':
-    if ((c = fgetc(in)) == '@') 
-      return cons(unquote_splice, read(in));
-    else {
-      ungetc(c, in);
-      return cons(unquote, read(in));
-    }
-  case '"':
-    return read_string(in);
-  case ';':
-    while ((c = fgetc(in)) != '\n');
-  default: ;
-    // fall through to finish reading
-  }
-
-  ungetc(c, in);
-  char *tok = gets_until(in, is_terminating);
-  obj_t it = read_mint(tok);
-  if (!nullp(it)) return it;
-  else return make_sym(intern_name(tok));
+// With LISP_STATS set in the environment, the heap's statistics are
+//  written to stderr on the way out, one "name value" pair a line, as
+//  bench/run.sh expects.
+void
+report_stats() {
+  gc_stat_t stats[NGC_STATS];
+  size_t nstats = read_gc_stats(stats);
+  for (size_t n = 0; n < nstats; n++)
+    fprintf(stderr, "%s %llu\n", stats[n].name,
+	    (unsigned long long)stats[n].value);
 }
 
+// With LISP_PROFILE set to a path, the whole run is profiled and the
+//  samples written there on the way out.
+void
+write_profile() {
+  stop_profile(getenv("LISP_PROFILE"));
+}
 
-jmp_buf errhandler;
-obj_t errobj;
-bool did_autoload = false;
-
-int main() {
-  symtable = symt_create(128);
-  nil = make_sym(make_self_evaluating("nil"));
-  t = make_sym(make_self_evaluating("t"));
+// lisp [--image FILE] [--dump-image FILE] [FILE...]
+int main(int argc, char **argv) {
+  const char *image_path = NULL, *dump_path = NULL;
+  int nfiles = 0;
+  for (int n = 1; n < argc; n++) {
+    if (!strcmp(argv[n], "--image") && n + 1 < argc)
+      image_path = argv[++n];
+    else if (!strcmp(argv[n], "--dump-image") && n + 1 < argc)
+      dump_path = argv[++n];
+    else argv[++nfiles] = argv[n];
+  }
+  if (getenv("LISP_STATS"))
+    atexit(report_stats);
+  if (getenv("LISP_PROFILE") && start_profile(DEFAULT_PROFILE_INTERVAL_US))
+    atexit(write_profile);
+
+  if (image_path) {
+    if (!load_image(image_path))
+      return 1;
+    nil = make_sym(intern_name("nil"));
+    t = make_sym(intern_name("t"));
+  } else {
+    symtable = symt_create(128);
+    nil = make_sym(make_self_evaluating("nil"));
+    t = make_sym(make_self_evaluating("t"));
+    setup_builtins();
+  }
   quote = make_sym(intern_name("quote"));
   quasiquote = make_sym(intern_name("quasiquote"));
   unquote = make_sym(intern_name("unquote"));
   unquote_splice = make_sym(intern_name("unquote-splice"));
 
-  setup_builtins();
-
-  FILE *autoload = fopen("autoload.lisp", "r");
-  if (!autoload) did_autoload = true;
+  // argv[0] makes way for autoload.lisp.
+  argv[0] = "autoload.lisp";
+  load_paths = argv;
+  nloads = nfiles + 1;
+  next_load = image_path? 1 : 0;
+  open_next_load();
+  reader_t *input = stream_reader(stdin);
 
   int ecode = setjmp(errhandler);
+
+  // An error stops a profile that compiled code started, as one the
+  //  interpreter started stops itself.
+  if (tracing) stop_tracing();
+
+  // Nothing protected before the error is still on the C stack.
+  root_depth = 0;
+  value_depth = 0;
+  frame_depth = 0;
+  unbind_to(0);
+  protect(&toplevel);
+
   if (ecode == 0 || ecode == E_TRY_AGAIN) {
-    while(!did_autoload) {
-      eval(read(autoload));
+    while(loading) {
+      toplevel = read_form(loading);
+      if (loading->lexical)
+	eval_lexical(toplevel);
+      else eval(toplevel);
     }
+    if (dump_path)
+      exit(dump_image(dump_path)? 0 : 1);
     while(1) {
       printf("> ");
-      printy(eval(read(stdin)));
+      toplevel = read_form(input);
+      printy(eval(toplevel));
       putchar('\n');
     }
   } else switch(ecode) {
@@ -397,10 +595,10 @@ int main() {
       puts("* READ ERROR");
       longjmp(errhandler, E_TRY_AGAIN);
     case E_END_OF_FILE:
-      if (did_autoload) 
+      if (!loading)
 	exit(0);
       else {
-	did_autoload = true;
+	open_next_load();
 	longjmp(errhandler, E_TRY_AGAIN);
       }
     case E_NO_FUNCTION:
@@ -440,6 +638,11 @@ int main() {
       printy(errobj);
       putchar('\n');
       longjmp(errhandler, E_TRY_AGAIN);
+    case E_LEXICAL:
+      printf("* LEXICAL VARIABLE OUT OF SCOPE: ");
+      printy(errobj);
+      putchar('\n');
+      longjmp(errhandler, E_TRY_AGAIN);
     case E_RUNTIMEY:
       printf("* RUNTIME ERROR: ");
       while (consp(errobj)) {
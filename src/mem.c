@@ -0,0 +1,58 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lisp.h"
+
+// Reserve a large span of zeroed address space.  Pages aren't backed
+//  by memory until they're touched, so this is cheap even when most
+//  of it will never be used.
+void *
+reserve(size_t bytes) {
+  void *ret = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (ret == MAP_FAILED) die();
+  return ret;
+}
+
+// Maps a whole file read-only, or reads it into a buffer if it can't
+//  be mapped, as with a pipe.  Returns NULL if it can't be opened.
+char *
+load_file(const char *path, size_t *size, bool *mapped) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  char *ret = NULL;
+  *mapped = false;
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+    ret = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ret != MAP_FAILED) {
+      madvise(ret, st.st_size, MADV_SEQUENTIAL);
+      *size = st.st_size;
+      *mapped = true;
+      close(fd);
+      return ret;
+    }
+  }
+
+  size_t capacity = 4096, len = 0;
+  ret = malloc(capacity);
+  if (!ret) die();
+  for (ssize_t got; (got = read(fd, &ret[len], capacity - len)) > 0;)
+    if ((len += got) == capacity) {
+      ret = realloc(ret, capacity *= 2);
+      if (!ret) die();
+    }
+  close(fd);
+  *size = len;
+  return ret;
+}
+
+void
+unload_file(char *buf, size_t size, bool mapped) {
+  if (mapped) munmap(buf, size);
+  else free(buf);
+}
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lisp.h"
+
+// Every object allocated, so that the ones that weren't marked can be
+//  found and freed after a full collection.
+object_t **objects = NULL;
+size_t nobjects = 0;
+size_t objects_capacity = 0;
+
+// Objects don't fill up the cons store, so they trigger a collection
+//  of their own once the bytes allocated since the last one outgrow
+//  what was live after it.
+#define MIN_OBJECT_LIMIT ((size_t)1 << 20)
+size_t object_bytes = 0;
+size_t object_limit = MIN_OBJECT_LIMIT;
+
+
+object_t *
+add_object(enum type type, size_t bytes) {
+  if (nobjects == objects_capacity) {
+    objects_capacity = objects_capacity? objects_capacity * 2 : 256;
+    objects = realloc(objects, sizeof(object_t*) * objects_capacity);
+    if (!objects) die();
+  }
+
+  object_t *ret = malloc(bytes);
+  if (!ret) die();
+  ret->size = bytes;
+  ret->marked = false;
+  ret->type = type;
+  objects[nobjects++] = ret;
+  object_bytes += bytes;
+  return ret;
+}
+
+// Returns an unmarked object of the given size, header included.
+void *
+alloc_object(enum type type, size_t bytes) {
+  if (object_bytes + bytes > object_limit)
+    collect_garbage();
+  return add_object(type, bytes);
+}
+
+// Copies an object out of an image, without collecting.
+void *
+copy_object(const object_t *obj) {
+  object_t *ret = add_object(obj->type, obj->size);
+  memcpy(ret + 1, obj + 1, obj->size - sizeof(object_t));
+  return ret;
+}
+
+// Frees every object that wasn't marked, and clears the marks of the
+//  rest for next time.
+void
+sweep_objects() {
+  size_t live = 0;
+  object_bytes = 0;
+  for (size_t n = 0; n < nobjects; n++) {
+    object_t *obj = objects[n];
+    if (!obj->marked) {
+      free(obj);
+      continue;
+    }
+    obj->marked = false;
+    object_bytes += obj->size;
+    objects[live++] = obj;
+  }
+  nobjects = live;
+  object_limit = object_bytes * 2 > MIN_OBJECT_LIMIT?
+    object_bytes * 2 : MIN_OBJECT_LIMIT;
+}
@@ -0,0 +1,395 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <time.h>
+#include <sys/time.h>
+#include "lisp.h"
+#include "hash.h"
+#include "builtins.h"
+#include "profile.h"
+#include "bytecode.h"
+
+extern symt_t *symtable;
+extern jmp_buf errhandler;
+extern obj_t errobj;
+
+// Only the innermost frames of a deeper stack are kept, under a
+//  frame named "...".  Once the ring is full the oldest samples are
+//  overwritten.
+#define MAX_SAMPLE_DEPTH 64
+#define NSAMPLES ((size_t)1 << 14)
+
+typedef struct sample {
+  size_t depth;
+  frame_t frames[MAX_SAMPLE_DEPTH];
+} sample_t;
+
+sample_t *samples = NULL;
+volatile size_t samples_taken = 0;
+bool profiling = false;
+
+
+// Runs on SIGPROF, so it only copies.
+void
+take_sample(int sig) {
+  sample_t *s = &samples[samples_taken % NSAMPLES];
+  size_t depth = frame_depth;
+  size_t keep = depth < MAX_SAMPLE_DEPTH? depth : MAX_SAMPLE_DEPTH;
+  s->depth = depth;
+  for (size_t n = 0; n < keep; n++)
+    s->frames[n] = frame_stack[depth - keep + n];
+  samples_taken++;
+}
+
+bool
+set_timer(long interval_us) {
+  struct itimerval it = {
+    {interval_us / 1000000, interval_us % 1000000},
+    {interval_us / 1000000, interval_us % 1000000},
+  };
+  return !setitimer(ITIMER_PROF, &it, NULL);
+}
+
+bool
+start_profile(long interval_us) {
+  if (!samples) samples = reserve(sizeof(sample_t) * NSAMPLES);
+  if (interval_us <= 0) interval_us = DEFAULT_PROFILE_INTERVAL_US;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = take_sample;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  samples_taken = 0;
+  if (sigaction(SIGPROF, &sa, NULL) || !set_timer(interval_us)) {
+    perror("* CAN'T START PROFILER");
+    return false;
+  }
+  profiling = true;
+  return true;
+}
+
+
+// Frames are named by looking their functions up among the global
+//  values, when the samples are written.  A function that isn't one
+//  is named by the symbol it was called through, if any.
+typedef struct named {
+  func_t *fn;
+  const char *name;
+} named_t;
+
+int
+compare_named(const void *a, const void *b) {
+  uintptr_t x = (uintptr_t)((named_t*)a)->fn;
+  uintptr_t y = (uintptr_t)((named_t*)b)->fn;
+  return (x > y) - (x < y);
+}
+
+named_t *
+name_functions(size_t *count) {
+  named_t *ret = malloc(sizeof(named_t) * (symtable->nitems + 1));
+  if (!ret) die();
+  size_t n = 0;
+  for (size_t slot = 0; slot < symtable->nslots; slot++) {
+    sym_t *sym = symtable->slots[slot];
+    if (sym && funcp(sym->val))
+      ret[n++] = (named_t){as_func(sym->val), sym->key};
+  }
+  qsort(ret, n, sizeof(named_t), compare_named);
+  *count = n;
+  return ret;
+}
+
+const char *
+frame_name(frame_t *frame, named_t *names, size_t nnames) {
+  named_t key = {frame->fn, NULL};
+  named_t *found = bsearch(&key, names, nnames, sizeof(named_t),
+			   compare_named);
+  if (found) return found->name;
+  if (symp(frame->name) && !nullp(frame->name))
+    return as_sym(frame->name)->key;
+  return "lambda";
+}
+
+int
+compare_strs(const void *a, const void *b) {
+  return strcmp(*(char**)a, *(char**)b);
+}
+
+// Each sample is spelled out in full, and then they're sorted so that
+//  identical stacks come together to be counted.
+long
+stop_profile(const char *path) {
+  if (profiling) {
+    set_timer(0);
+    profiling = false;
+  }
+
+  FILE *out = path? fopen(path, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "* CAN'T OPEN %s\n", path);
+    return -1;
+  }
+
+  size_t nnames;
+  named_t *names = name_functions(&nnames);
+  size_t nsamples = samples_taken < NSAMPLES? samples_taken : NSAMPLES;
+  char **stacks = malloc(sizeof(char*) * (nsamples + 1));
+  if (!stacks) die();
+
+  for (size_t n = 0; n < nsamples; n++) {
+    sample_t *s = &samples[n];
+    size_t keep = s->depth < MAX_SAMPLE_DEPTH? s->depth : MAX_SAMPLE_DEPTH;
+    size_t len = 0, size = 64;
+    char *stack = malloc(size);
+    if (!stack) die();
+    stack[0] = 0;
+
+    const char *outer = s->depth > keep? "..." : "toplevel";
+    for (size_t i = 0; i <= keep; i++) {
+      const char *name = i? frame_name(&s->frames[i - 1], names, nnames)
+	: outer;
+      size_t namelen = strlen(name);
+      if (len + namelen + 2 > size) {
+	stack = realloc(stack, size = 2 * (len + namelen + 2));
+	if (!stack) die();
+      }
+      if (i) stack[len++] = ';';
+      memcpy(&stack[len], name, namelen + 1);
+      len += namelen;
+    }
+    stacks[n] = stack;
+  }
+
+  qsort(stacks, nsamples, sizeof(char*), compare_strs);
+  for (size_t n = 0; n < nsamples;) {
+    size_t same = n + 1;
+    while (same < nsamples && !strcmp(stacks[same], stacks[n]))
+      same++;
+    fprintf(out, "%s %zu\n", stacks[n], same - n);
+    for (; n < same; n++)
+      free(stacks[n]);
+  }
+
+  if (path) fclose(out);
+  else fflush(out);
+  free(stacks);
+  free(names);
+  samples_taken = 0;
+  return nsamples;
+}
+
+
+// (profile-start) or (profile-start interval-us)
+obj_t
+fn_profile_start(size_t argc, obj_t *argv) {
+  long interval = DEFAULT_PROFILE_INTERVAL_US;
+  if (argc) {
+    if (!mintp(argv[0]) || as_mint(argv[0]) <= 0)
+      error(E_INVALID_ARG, argv[0]);
+    interval = as_mint(argv[0]);
+  }
+  return start_profile(interval)? t : nil;
+}
+
+// (profile-stop) or (profile-stop path), returning the number of
+//  samples written.
+obj_t
+fn_profile_stop(size_t argc, obj_t *argv) {
+  if (!argc)
+    return make_mint(stop_profile(NULL));
+  if (!stringp(argv[0]))
+    error(E_INVALID_ARG, argv[0]);
+
+  string_t *str = as_string(argv[0]);
+  char *path = malloc(str->len + 1);
+  if (!path) die();
+  memcpy(path, str->bytes, str->len);
+  path[str->len] = 0;
+  long ret = stop_profile(path);
+  free(path);
+  return ret < 0? nil : make_mint(ret);
+}
+
+
+// The deterministic profiler.  Every function called while it's on
+//  gets a record in a table keyed by the function object, and every
+//  frame pushed meanwhile gets an entry here at the same depth, so
+//  that time and conses can be split between a call and the calls it
+//  makes.  Only the outermost of a function's calls adds to its total
+//  time, so recursion isn't counted twice.
+typedef struct record {
+  func_t *fn;
+  obj_t name;
+  size_t calls, active, expansions;
+  uint64_t total_ns, self_ns;
+  size_t self_conses;
+} record_t;
+
+typedef struct trace {
+  record_t *rec;
+  uint64_t start_ns, child_ns;
+  size_t start_conses, child_conses;
+} trace_t;
+
+// Records don't move when the table grows, since traces point to them.
+bool tracing = false;
+record_t **records = NULL;
+size_t records_size = 0, nrecords = 0;
+trace_t *traces = NULL;
+size_t trace_base;
+
+uint64_t
+clock_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+size_t
+record_slot(func_t *fn) {
+  size_t mask = records_size - 1;
+  size_t slot = ((uintptr_t)fn >> 4) * 0x9e3779b97f4a7c15 >> 32 & mask;
+  while (records[slot] && records[slot]->fn != fn)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+// A new function gets its name from the first call site seen.
+record_t *
+find_record(func_t *fn, obj_t name) {
+  if (2 * (nrecords + 1) > records_size) {
+    record_t **old = records;
+    size_t old_size = records_size;
+    records_size = records_size? records_size * 2 : 256;
+    records = calloc(records_size, sizeof(record_t*));
+    if (!records) die();
+    for (size_t n = 0; n < old_size; n++)
+      if (old[n])
+	records[record_slot(old[n]->fn)] = old[n];
+    free(old);
+  }
+
+  record_t **slot = &records[record_slot(fn)];
+  if (!*slot) {
+    *slot = calloc(1, sizeof(record_t));
+    if (!*slot) die();
+    (*slot)->fn = fn;
+    (*slot)->name = name;
+    nrecords++;
+  }
+  return *slot;
+}
+
+void
+trace_enter(func_t *fn, obj_t name) {
+  record_t *rec = find_record(fn, name);
+  rec->calls++;
+  rec->active++;
+  traces[frame_depth - 1] = (trace_t){rec, clock_ns(), 0, conses_made(), 0};
+}
+
+// Frames from before the profiler started are left alone.
+void
+trace_exit() {
+  size_t depth = frame_depth - 1;
+  if (depth < trace_base) return;
+
+  trace_t *tr = &traces[depth];
+  uint64_t ns = clock_ns() - tr->start_ns;
+  size_t conses = conses_made() - tr->start_conses;
+  record_t *rec = tr->rec;
+  rec->self_ns += ns - tr->child_ns;
+  rec->self_conses += conses - tr->child_conses;
+  if (!--rec->active) rec->total_ns += ns;
+  if (depth > trace_base) {
+    tr[-1].child_ns += ns;
+    tr[-1].child_conses += conses;
+  }
+}
+
+void
+trace_expansion(func_t *macro) {
+  find_record(macro, nil)->expansions++;
+}
+
+int
+compare_self_ns(const void *a, const void *b) {
+  uint64_t x = (*(record_t**)a)->self_ns, y = (*(record_t**)b)->self_ns;
+  return (x < y) - (x > y);
+}
+
+// Builtins that compiled code runs as instructions aren't listed,
+//  since only the calls the interpreter made to them were counted.
+void
+print_trace_report() {
+  record_t **sorted = malloc(sizeof(record_t*) * (nrecords + 1));
+  if (!sorted) die();
+  size_t n = 0;
+  for (size_t slot = 0; slot < records_size; slot++)
+    if (records[slot] && !inlined_builtin(records[slot]->fn))
+      sorted[n++] = records[slot];
+  qsort(sorted, n, sizeof(record_t*), compare_self_ns);
+
+  size_t nnames;
+  named_t *names = name_functions(&nnames);
+  printf("%10s %12s %12s %12s %10s  %s\n",
+	 "calls", "total ms", "self ms", "self conses", "expanded", "function");
+  for (size_t i = 0; i < n; i++) {
+    record_t *rec = sorted[i];
+    frame_t frame = {rec->fn, rec->name};
+    printf("%10zu %12.3f %12.3f %12zu %10zu  %s\n", rec->calls,
+	   rec->total_ns / 1e6, rec->self_ns / 1e6, rec->self_conses,
+	   rec->expansions, frame_name(&frame, names, nnames));
+  }
+  free(names);
+  free(sorted);
+}
+
+void
+stop_tracing() {
+  tracing = false;
+  print_trace_report();
+  for (size_t slot = 0; slot < records_size; slot++)
+    free(records[slot]);
+  free(records);
+  records = NULL;
+  records_size = nrecords = 0;
+}
+
+bool
+start_tracing() {
+  if (tracing) return false;
+  if (!traces) traces = reserve(sizeof(trace_t) * FRAME_STACK_SIZE);
+  trace_base = frame_depth;
+  tracing = true;
+  return true;
+}
+
+// (profile expr) evaluates expr with every call timed, and prints a
+//  report sorted by the time spent in each function itself before
+//  returning its value.  An error stops it too, and then goes on to
+//  the top level as usual.  Nested uses just evaluate.  Compiled code
+//  does the same with OP_PROFILE and OP_END_PROFILE.
+obj_t
+op_profile(obj_t args) {
+  if (!start_tracing())
+    return eval(car(args));
+
+  jmp_buf saved;
+  memcpy(saved, errhandler, sizeof(jmp_buf));
+  int ecode = setjmp(errhandler);
+  if (ecode) {
+    memcpy(errhandler, saved, sizeof(jmp_buf));
+    stop_tracing();
+    error(ecode, errobj);
+  }
+
+  obj_t ret = eval(car(args));
+  memcpy(errhandler, saved, sizeof(jmp_buf));
+  stop_tracing();
+  return ret;
+}
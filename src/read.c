@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "lisp.h"
+#include "hash.h"
+#include "read.h"
+#include "bignum.h"
+
+extern obj_t quote, quasiquote, unquote, unquote_splice;
+
+reader_t *
+open_reader(const char *path) {
+  reader_t *r = calloc(1, sizeof(reader_t));
+  if (!r) die();
+  r->buf = load_file(path, &r->size, &r->mapped);
+  if (!r->buf) {
+    free(r);
+    return NULL;
+  }
+  r->next = r->buf;
+  r->end = r->buf + r->size;
+
+  static const char mode[] = "-*- lexical -*-";
+  const char *eol = memchr(r->buf, '\n', r->size);
+  size_t len = eol? (size_t)(eol - r->buf) : r->size;
+  for (size_t n = 0; !r->lexical && n + sizeof(mode) - 1 <= len; n++)
+    r->lexical = !memcmp(&r->buf[n], mode, sizeof(mode) - 1);
+  return r;
+}
+
+reader_t *
+stream_reader(FILE *in) {
+  reader_t *r = calloc(1, sizeof(reader_t));
+  if (!r) die();
+  r->in = in;
+  r->buf = malloc(r->size = 256);
+  if (!r->buf) die();
+  r->next = r->end = r->buf;
+  return r;
+}
+
+void
+close_reader(reader_t *r) {
+  if (r->in) free(r->buf);
+  else unload_file(r->buf, r->size, r->mapped);
+  free(r);
+}
+
+// Reads the next whole line of a stream into the buffer, returning
+//  false at the end of it.
+bool
+refill(reader_t *r) {
+  if (!r->in) return false;
+
+  size_t len = 0;
+  while (fgets(&r->buf[len], r->size - len, r->in)) {
+    len += strlen(&r->buf[len]);
+    if (r->buf[len - 1] == '\n') break;
+    if (len == r->size - 1) {
+      r->buf = realloc(r->buf, r->size *= 2);
+      if (!r->buf) die();
+    }
+  }
+  r->next = r->buf;
+  r->end = r->buf + len;
+  return len;
+}
+
+// Returns the next character without taking it, or EOF.
+static inline int
+peek(reader_t *r) {
+  if (r->next == r->end && !refill(r)) return EOF;
+  return (unsigned char)*r->next;
+}
+
+static inline bool
+is_terminating(char c) {
+  return c=='(' || c==')' || isspace((unsigned char)c);
+}
+
+int
+skip_space(reader_t *r) {
+  int c;
+  while ((c = peek(r)) != EOF && isspace(c))
+    r->next++;
+  return c;
+}
+
+
+// Numbers are parsed from a terminated copy, which only tokens that
+//  could be one need, and strings that span more than one line of a
+//  stream are gathered here too.  It's reused and only grows.
+char *token_buf = NULL;
+size_t token_size = 0;
+
+void
+grow_token_buf(size_t len) {
+  if (len >= token_size) {
+    token_buf = realloc(token_buf, token_size = len + 64);
+    if (!token_buf) die();
+  }
+}
+
+obj_t
+read_mint(const char *tok, size_t len) {
+  grow_token_buf(len);
+  memcpy(token_buf, tok, len);
+  token_buf[len] = 0;
+
+  // Anything strtol() can't hold, or that won't fit in a mint, is
+  //  parsed again as a bignum.
+  char *endptr = token_buf;
+  errno = 0;
+  long x = strtol(token_buf, &endptr, 0);
+  if (*endptr) return nil;
+  if (errno != ERANGE && x >= MINT_MIN && x <= MINT_MAX)
+    return make_mint(x);
+  return parse_integer(token_buf);
+}
+
+// A symbol's name is hashed as it's scanned, and only copied if it's
+//  new.  An empty token, as after a comment, reads as 0.
+obj_t
+read_token(reader_t *r) {
+  const char *start = r->next;
+  hash_t h = HASH_SEED;
+  while (r->next < r->end && !is_terminating(*r->next))
+    h = hash_step(h, *r->next++);
+
+  size_t len = r->next - start;
+  if (!len || isdigit((unsigned char)*start)
+      || *start == '+' || *start == '-') {
+    obj_t it = read_mint(start, len);
+    if (!nullp(it)) return it;
+  }
+  return make_sym(intern_hashed(start, len, hash_mix(h)));
+}
+
+// A string runs to the next quote that doesn't follow a backslash,
+//  and the backslashes are kept.  It's copied straight out of the
+//  buffer unless a refill comes first.
+obj_t
+read_string(reader_t *r) {
+  size_t len = 0;
+  bool backslashed = false;
+  for (;;) {
+    const char *start = r->next;
+    while (r->next < r->end) {
+      char c = *r->next++;
+      if (c == '"' && !backslashed) {
+	size_t n = r->next - 1 - start;
+	if (!len) return string_from(start, n);
+	grow_token_buf(len + n);
+	memcpy(&token_buf[len], start, n);
+	return string_from(token_buf, len + n);
+      }
+      backslashed = c == '\\';
+    }
+
+    size_t n = r->next - start;
+    grow_token_buf(len + n);
+    memcpy(&token_buf[len], start, n);
+    len += n;
+    if (peek(r) == EOF)
+      return string_from(token_buf, len);
+  }
+}
+
+// The opening parenthesis has been taken.  Elements are added at the
+//  tail, so a long list doesn't need a deep C stack.
+obj_t
+read_list(reader_t *r) {
+  obj_t head = nil, tail = nil;
+  protect(&head);
+  protect(&tail);
+
+  for (;;) {
+    int c = skip_space(r);
+    if (c == ')') {
+      r->next++;
+      break;
+    }
+    if (c == '.') {
+      r->next++;
+      obj_t rest = read_form(r);
+      if (nullp(tail)) head = rest;
+      else rplacd(tail, rest);
+      if ((c = skip_space(r)) != EOF) r->next++;
+      if (c != ')')
+	error(E_READ_ERROR, nil);
+      break;
+    }
+
+    obj_t cell = cons(read_form(r), nil);
+    if (nullp(tail)) head = cell;
+    else rplacd(tail, cell);
+    tail = cell;
+  }
+
+  unprotect(2);
+  return head;
+}
+
+// #(...) reads as a vector of the forms inside, unevaluated.
+obj_t
+read_vector(reader_t *r) {
+  obj_t list = read_list(r);
+  for (obj_t ptr = list; !nullp(ptr); ptr = cdr(ptr))
+    if (!consp(ptr))
+      error(E_READ_ERROR, nil);
+  return list_to_vector(list);
+}
+
+obj_t
+read_form(reader_t *r) {
+  int c = skip_space(r);
+  if (c != EOF) r->next++;
+
+  switch (c) {
+  case EOF:
+    error(E_END_OF_FILE, nil);
+  case ')':
+    error(E_READ_ERROR, nil);
+  case '(':
+    return read_list(r);
+  case '\'':
+    return cons(quote, read_form(r));
+  case '`':
+    return cons(quasiquote, read_form(r));
+  case ',':
+    if (peek(r) == '@') {
+      r->next++;
+      return cons(unquote_splice, read_form(r));
+    } else return cons(unquote, read_form(r));
+  case '"':
+    return read_string(r);
+  case '#':
+    // Not peek(), which could refill and lose the '#'.
+    if (r->next < r->end && *r->next == '(') {
+      r->next++;
+      return read_vector(r);
+    }
+    r->next--;
+    return read_token(r);
+  case ';':
+    while ((c = peek(r)) != EOF && c != '\n')
+      r->next++;
+    return read_token(r);
+  default:
+    r->next--;
+    return read_token(r);
+  }
+}
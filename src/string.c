@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "lisp.h"
+#include "builtins.h"
+
+string_t *
+alloc_string(size_t len) {
+  string_t *ret = alloc_object(TYPE_STRING, sizeof(string_t) + len + 1);
+  ret->len = len;
+  ret->bytes[len] = 0;
+  return ret;
+}
+
+obj_t
+string_from(const char *bytes, size_t len) {
+  string_t *ret = alloc_string(len);
+  memcpy(ret->bytes, bytes, len);
+  return make_string(ret);
+}
+
+string_t *
+string_arg(obj_t obj) {
+  if (!stringp(obj))
+    error(E_INVALID_ARG, obj);
+  return as_string(obj);
+}
+
+// Characters are mints holding a byte.
+int
+char_arg(obj_t obj) {
+  if (!mintp(obj) || as_mint(obj) < 0 || as_mint(obj) > UCHAR_MAX)
+    error(E_INVALID_ARG, obj);
+  return as_mint(obj);
+}
+
+obj_t
+fn_stringp(size_t argc, obj_t *argv) {
+  return stringp(argv[0])? t : nil;
+}
+
+obj_t
+fn1_string_length(obj_t str) {
+  return make_mint(string_arg(str)->len);
+}
+
+obj_t
+fn_string_length(size_t argc, obj_t *argv) {
+  return fn1_string_length(argv[0]);
+}
+
+obj_t
+fn2_string_ref(obj_t obj, obj_t idx) {
+  string_t *str = string_arg(obj);
+  return make_mint((unsigned char)str->bytes[index_arg(idx, str->len)]);
+}
+
+obj_t
+fn_string_ref(size_t argc, obj_t *argv) {
+  return fn2_string_ref(argv[0], argv[1]);
+}
+
+// (substring s start) or (substring s start end), end exclusive.
+obj_t
+fn_substring(size_t argc, obj_t *argv) {
+  string_t *str = string_arg(argv[0]);
+  size_t start = index_arg(argv[1], str->len + 1);
+  size_t end = argc == 3? index_arg(argv[2], str->len + 1) : str->len;
+  if (end < start)
+    error(E_INVALID_ARG, argv[2]);
+  return string_from(&str->bytes[start], end - start);
+}
+
+obj_t
+fn_string_append(size_t argc, obj_t *argv) {
+  size_t len = 0;
+  for (size_t n = 0; n < argc; n++)
+    len += string_arg(argv[n])->len;
+
+  string_t *ret = alloc_string(len);
+  char *dest = ret->bytes;
+  for (size_t n = 0; n < argc; n++) {
+    string_t *str = as_string(argv[n]);
+    memcpy(dest, str->bytes, str->len);
+    dest += str->len;
+  }
+  return make_string(ret);
+}
+
+obj_t
+fn_string_equal(size_t argc, obj_t *argv) {
+  for (size_t n = 0; n < argc; n++)
+    string_arg(argv[n]);
+
+  for (size_t n = 1; n < argc; n++) {
+    string_t *a = as_string(argv[0]), *b = as_string(argv[n]);
+    if (a->len != b->len || memcmp(a->bytes, b->bytes, a->len))
+      return nil;
+  }
+  return t;
+}
+
+// Strings convert to and from lists of their characters, which is
+//  what strings used to be.
+obj_t
+fn_string_to_list(size_t argc, obj_t *argv) {
+  string_t *str = string_arg(argv[0]);
+  obj_t ret = nil;
+  protect(&ret);
+  for (size_t n = str->len; n--;)
+    ret = cons(make_mint((unsigned char)str->bytes[n]), ret);
+  unprotect(1);
+  return ret;
+}
+
+obj_t
+fn_list_to_string(size_t argc, obj_t *argv) {
+  size_t len = 0;
+  obj_t list;
+  for (list = argv[0]; consp(list); list = cdr(list), len++)
+    char_arg(car(list));
+  if (!nullp(list))
+    error(E_INVALID_ARG, argv[0]);
+
+  // The list may have moved.
+  string_t *ret = alloc_string(len);
+  list = argv[0];
+  for (size_t n = 0; n < len; n++, list = cdr(list))
+    ret->bytes[n] = as_mint(car(list));
+  return make_string(ret);
+}
+
+
+obj_t
+fn_is_lower(size_t argc, obj_t *argv) {
+  return islower(char_arg(argv[0]))? t : nil;
+}
+
+obj_t
+fn_is_upper(size_t argc, obj_t *argv) {
+  return isupper(char_arg(argv[0]))? t : nil;
+}
+
+obj_t
+fn_is_digit(size_t argc, obj_t *argv) {
+  return isdigit(char_arg(argv[0]))? t : nil;
+}
+
+// Changes the case of a character, or of every character in a
+//  string, which gives a new string.
+obj_t
+change_case(obj_t obj, int (*convert)(int)) {
+  if (mintp(obj))
+    return make_mint(convert(char_arg(obj)));
+
+  string_t *str = string_arg(obj);
+  string_t *ret = alloc_string(str->len);
+  for (size_t n = 0; n < str->len; n++)
+    ret->bytes[n] = convert((unsigned char)str->bytes[n]);
+  return make_string(ret);
+}
+
+obj_t
+fn_to_upper(size_t argc, obj_t *argv) {
+  return change_case(argv[0], toupper);
+}
+
+obj_t
+fn_to_lower(size_t argc, obj_t *argv) {
+  return change_case(argv[0], tolower);
+}
@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lisp.h"
+#include "hash.h"
+#include "builtins.h"
+#include "bignum.h"
+
+#define MIN_TABLE_SLOTS 8
+
+// The most entries make-hash can be asked to make room for, whose
+//  vector is then still within MAX_VECTOR_LEN.
+#define MAX_TABLE_SIZE (MAX_VECTOR_LEN / 8)
+
+// Entries moved out of the old vector by each operation while the
+//  table is growing.  That's enough for the moving to be done before
+//  the new entries can fill up, though growing finishes it anyway.
+#define MOVES_PER_OP 8
+
+// The first word of an entry.  One in use holds a mint made from its
+//  hash that is never either of these.  Keys and values that aren't
+//  in use are the mint 0, which is left alone by the collector.
+#define EMPTY make_mint(0)
+#define DELETED make_mint(1)
+#define VACANT make_mint(0)
+
+static inline obj_t
+hash_mark(hash_t h) {
+  return make_mint((h >> 4) | 2);
+}
+
+static inline size_t
+nslots(obj_t entries) {
+  return as_vector(entries)->len / 3;
+}
+
+hash_t
+key_hash(obj_t key) {
+  hash_t h = HASH_SEED;
+  if (stringp(key)) {
+    string_t *str = as_string(key);
+    for (size_t n = 0; n < str->len; n++)
+      h = hash_step(h, str->bytes[n]);
+  } else if (bignump(key)) {
+    bignum_t *num = as_bignum(key);
+    h = h * 33 + num->negative;
+    for (size_t n = 0; n < num->len; n++)
+      h = h * 0x100000001b3 + num->limbs[n];
+  } else if (consp(key))
+    error(E_INVALID_ARG, key);
+  else h = key._bits;
+  return hash_mix(h);
+}
+
+bool
+key_equal(obj_t a, obj_t b) {
+  if (eqp(a, b)) return true;
+  if (stringp(a) && stringp(b))
+    return as_string(a)->len == as_string(b)->len
+      && !memcmp(as_string(a)->bytes, as_string(b)->bytes, as_string(a)->len);
+  return bignump(a) && bignump(b) && !int_compare(a, b);
+}
+
+// Returns the entry holding key, or else -1, having set *vacant to
+//  the first entry the key could go in if there's room.
+long
+find_entry(obj_t entries, obj_t key, hash_t h, long *vacant) {
+  obj_t *slots = as_vector(entries)->slots;
+  size_t mask = nslots(entries) - 1;
+  obj_t mark = hash_mark(h);
+  *vacant = -1;
+  for (size_t n = h & mask;; n = (n + 1) & mask) {
+    obj_t state = slots[3 * n];
+    if (eqp(state, EMPTY)) {
+      if (*vacant < 0) *vacant = n;
+      return -1;
+    }
+    if (eqp(state, DELETED)) {
+      if (*vacant < 0) *vacant = n;
+    } else if (eqp(state, mark) && key_equal(slots[3 * n + 1], key))
+      return n;
+  }
+}
+
+void
+clear_entry(obj_t entries, long n) {
+  obj_t *slots = as_vector(entries)->slots;
+  slots[3 * n] = DELETED;
+  slots[3 * n + 1] = VACANT;
+  slots[3 * n + 2] = VACANT;
+}
+
+// Puts a key that isn't in the new entries there, which has room.
+void
+add_entry(table_t *tab, obj_t key, hash_t h, obj_t val) {
+  long vacant;
+  find_entry(tab->entries, key, h, &vacant);
+  vector_t *vec = as_vector(tab->entries);
+  if (eqp(vec->slots[3 * vacant], EMPTY)) tab->used++;
+  vec->slots[3 * vacant] = hash_mark(h);
+  vector_set(vec, 3 * vacant + 1, key);
+  vector_set(vec, 3 * vacant + 2, val);
+}
+
+// An old entry is marked deleted once it has moved, so that searches
+//  of the old vector still carry on past it.
+void
+move_entries(table_t *tab, size_t count) {
+  if (nullp(tab->old)) return;
+
+  size_t end = nslots(tab->old);
+  obj_t *slots = as_vector(tab->old)->slots;
+  for (; count && tab->moved < end; count--, tab->moved++) {
+    obj_t state = slots[3 * tab->moved];
+    if (eqp(state, EMPTY) || eqp(state, DELETED)) continue;
+    obj_t key = slots[3 * tab->moved + 1];
+    add_entry(tab, key, key_hash(key), slots[3 * tab->moved + 2]);
+    clear_entry(tab->old, tab->moved);
+  }
+  if (tab->moved == end) tab->old = nil;
+}
+
+obj_t
+new_entries(size_t nslots) {
+  vector_t *vec = alloc_vector(3 * nslots);
+  for (size_t n = 0; n < 3 * nslots; n++)
+    vec->slots[n] = VACANT;
+  return make_vector(vec);
+}
+
+// Starts moving into new entries, twice as many unless most of the
+//  ones in use were deleted.  This may collect.
+void
+grow_table(table_t *tab) {
+  move_entries(tab, SIZE_MAX);
+  size_t n = nslots(tab->entries);
+  obj_t entries = new_entries(2 * tab->count >= n? 2 * n : n);
+  tab->old = tab->entries;
+  tab->entries = entries;
+  tab->moved = 0;
+  tab->used = 0;
+}
+
+table_t *
+alloc_table(size_t size) {
+  size_t n = MIN_TABLE_SLOTS;
+  while (n * 3 < size * 4) n *= 2;
+  obj_t entries = new_entries(n);
+  protect(&entries);
+  table_t *ret = alloc_object(TYPE_TABLE, sizeof(table_t));
+  ret->count = ret->used = 0;
+  ret->entries = entries;
+  ret->old = nil;
+  ret->moved = 0;
+  unprotect(1);
+  return ret;
+}
+
+// Any reference to something's address is stale in a table loaded
+//  from an image, so all of its keys are hashed again, in place.  It
+//  was dumped with nothing left to move, and nil isn't known yet.
+void
+rehash_table(table_t *tab) {
+  vector_t *vec = as_vector(tab->entries);
+  obj_t *pairs = malloc(sizeof(obj_t) * (2 * tab->count + 1));
+  if (!pairs) die();
+
+  size_t npairs = 0;
+  for (size_t n = 0; n < vec->len; n += 3) {
+    if (!eqp(vec->slots[n], EMPTY) && !eqp(vec->slots[n], DELETED)) {
+      pairs[npairs++] = vec->slots[n + 1];
+      pairs[npairs++] = vec->slots[n + 2];
+    }
+    vec->slots[n] = EMPTY;
+  }
+  tab->used = 0;
+  for (size_t n = 0; n < npairs; n += 2)
+    add_entry(tab, pairs[n], key_hash(pairs[n]), pairs[n + 1]);
+  free(pairs);
+}
+
+
+table_t *
+table_arg(obj_t obj) {
+  if (!tablep(obj))
+    error(E_INVALID_ARG, obj);
+  return as_table(obj);
+}
+
+obj_t
+fn_tablep(size_t argc, obj_t *argv) {
+  return tablep(argv[0])? t : nil;
+}
+
+// (make-hash) or (make-hash n), to hold n entries without growing.
+obj_t
+fn_make_hash(size_t argc, obj_t *argv) {
+  size_t size = 0;
+  if (argc) {
+    if (!mintp(argv[0]) || as_mint(argv[0]) < 0
+	|| (size_t)as_mint(argv[0]) > MAX_TABLE_SIZE)
+      error(E_INVALID_ARG, argv[0]);
+    size = as_mint(argv[0]);
+  }
+  return make_table(alloc_table(size));
+}
+
+// (hash-get h key) or (hash-get h key default), which is otherwise
+//  nil.
+obj_t
+fn_hash_get(size_t argc, obj_t *argv) {
+  table_t *tab = table_arg(argv[0]);
+  hash_t h = key_hash(argv[1]);
+  move_entries(tab, MOVES_PER_OP);
+
+  long vacant, n = find_entry(tab->entries, argv[1], h, &vacant);
+  if (n >= 0)
+    return as_vector(tab->entries)->slots[3 * n + 2];
+  if (!nullp(tab->old) && (n = find_entry(tab->old, argv[1], h, &vacant)) >= 0)
+    return as_vector(tab->old)->slots[3 * n + 2];
+  return argc == 3? argv[2] : nil;
+}
+
+// A key still in the old entries is taken out and put in the new.
+obj_t
+fn_hash_put(size_t argc, obj_t *argv) {
+  table_t *tab = table_arg(argv[0]);
+  obj_t key = argv[1], val = argv[2];
+  hash_t h = key_hash(key);
+  move_entries(tab, MOVES_PER_OP);
+
+  long vacant, n = find_entry(tab->entries, key, h, &vacant);
+  if (n >= 0) {
+    vector_set(as_vector(tab->entries), 3 * n + 2, val);
+    return argv[0];
+  }
+  if (!nullp(tab->old) && (n = find_entry(tab->old, key, h, &vacant)) >= 0) {
+    clear_entry(tab->old, n);
+    tab->count--;
+  }
+
+  if ((tab->used + 1) * 4 > nslots(tab->entries) * 3)
+    grow_table(tab);
+  add_entry(tab, key, h, val);
+  tab->count++;
+  return argv[0];
+}
+
+// Returns whether the key was there.
+obj_t
+fn_hash_remove(size_t argc, obj_t *argv) {
+  table_t *tab = table_arg(argv[0]);
+  hash_t h = key_hash(argv[1]);
+  move_entries(tab, MOVES_PER_OP);
+
+  long vacant, n = find_entry(tab->entries, argv[1], h, &vacant);
+  if (n >= 0)
+    clear_entry(tab->entries, n);
+  else if (!nullp(tab->old) && (n = find_entry(tab->old, argv[1], h, &vacant)) >= 0)
+    clear_entry(tab->old, n);
+  else return nil;
+  tab->count--;
+  return t;
+}
+
+obj_t
+fn_hash_count(size_t argc, obj_t *argv) {
+  return make_mint(table_arg(argv[0])->count);
+}
+
+// Conses up the entries of a table in no particular order: each key
+//  and value as a pair if both is set, or else just the keys.
+obj_t
+table_to_list(obj_t obj, bool both) {
+  table_t *tab = table_arg(obj);
+  obj_t ret = nil;
+  protect(&ret);
+  obj_t vecs[2] = {tab->entries, tab->old};
+  for (size_t v = 0; v < 2; v++) {
+    if (nullp(vecs[v])) continue;
+    vector_t *vec = as_vector(vecs[v]);
+    for (size_t n = 0; n < vec->len; n += 3) {
+      if (eqp(vec->slots[n], EMPTY) || eqp(vec->slots[n], DELETED))
+	continue;
+      obj_t item = both? cons(vec->slots[n + 1], vec->slots[n + 2])
+	: vec->slots[n + 1];
+      ret = cons(item, ret);
+    }
+  }
+  unprotect(1);
+  return ret;
+}
+
+obj_t
+fn_hash_keys(size_t argc, obj_t *argv) {
+  return table_to_list(argv[0], false);
+}
+
+obj_t
+fn_hash_to_list(size_t argc, obj_t *argv) {
+  return table_to_list(argv[0], true);
+}
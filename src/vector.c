@@ -0,0 +1,108 @@
+#include "lisp.h"
+#include "builtins.h"
+
+vector_t *
+alloc_vector(size_t len) {
+  vector_t *ret = alloc_object(TYPE_VECTOR, sizeof(vector_t) + sizeof(obj_t) * len);
+  ret->len = len;
+  for (size_t n = 0; n < len; n++)
+    ret->slots[n] = nil;
+  return ret;
+}
+
+// Makes a vector of the elements of a proper list.
+obj_t
+list_to_vector(obj_t list) {
+  size_t len = 0;
+  obj_t ptr;
+  for (ptr = list; consp(ptr); ptr = cdr(ptr)) len++;
+  if (!nullp(ptr))
+    error(E_INVALID_ARG, list);
+
+  protect(&list);
+  vector_t *ret = alloc_vector(len);
+  for (size_t n = 0; n < len; n++, list = cdr(list))
+    vector_set(ret, n, car(list));
+  unprotect(1);
+  return make_vector(ret);
+}
+
+
+vector_t *
+vector_arg(obj_t obj) {
+  if (!vectorp(obj))
+    error(E_INVALID_ARG, obj);
+  return as_vector(obj);
+}
+
+obj_t
+fn_vectorp(size_t argc, obj_t *argv) {
+  return vectorp(argv[0])? t : nil;
+}
+
+obj_t
+fn_vector(size_t argc, obj_t *argv) {
+  vector_t *ret = alloc_vector(argc);
+  for (size_t n = 0; n < argc; n++)
+    vector_set(ret, n, argv[n]);
+  return make_vector(ret);
+}
+
+// (make-vector n) or (make-vector n fill), which is otherwise nil.
+obj_t
+fn_make_vector(size_t argc, obj_t *argv) {
+  if (!mintp(argv[0]) || as_mint(argv[0]) < 0
+      || (size_t)as_mint(argv[0]) > MAX_VECTOR_LEN)
+    error(E_INVALID_ARG, argv[0]);
+
+  size_t len = as_mint(argv[0]);
+  vector_t *ret = alloc_vector(len);
+  if (argc == 2)
+    for (size_t n = 0; n < len; n++)
+      vector_set(ret, n, argv[1]);
+  return make_vector(ret);
+}
+
+obj_t
+fn1_vector_length(obj_t vec) {
+  return make_mint(vector_arg(vec)->len);
+}
+
+obj_t
+fn_vector_length(size_t argc, obj_t *argv) {
+  return fn1_vector_length(argv[0]);
+}
+
+obj_t
+fn2_vector_ref(obj_t obj, obj_t idx) {
+  vector_t *vec = vector_arg(obj);
+  return vec->slots[index_arg(idx, vec->len)];
+}
+
+obj_t
+fn_vector_ref(size_t argc, obj_t *argv) {
+  return fn2_vector_ref(argv[0], argv[1]);
+}
+
+obj_t
+fn_vector_set(size_t argc, obj_t *argv) {
+  vector_t *vec = vector_arg(argv[0]);
+  vector_set(vec, index_arg(argv[1], vec->len), argv[2]);
+  return argv[0];
+}
+
+obj_t
+fn_vector_to_list(size_t argc, obj_t *argv) {
+  vector_t *vec = vector_arg(argv[0]);
+  obj_t ret = nil;
+  protect(&ret);
+  for (size_t n = vec->len; n--;)
+    ret = cons(vec->slots[n], ret);
+  unprotect(1);
+  return ret;
+}
+
+obj_t
+fn_list_to_vector(size_t argc, obj_t *argv) {
+  return list_to_vector(argv[0]);
+}
@@ -0,0 +1,311 @@
+#include <string.h>
+#include "lisp.h"
+#include "hash.h"
+#include "builtins.h"
+#include "bytecode.h"
+
+// Two mints are added, subtracted or compared with the tags left on,
+//  since the tag of a mint is zero, which also makes the overflow
+//  checks match the range of a mint.  Anything else, or a result that
+//  doesn't fit, goes to the builtin's direct entry point; the operands
+//  stay on the stack meanwhile.
+#define BINARY(fn, expr) {						\
+    obj_t *argv = &value_stack[value_depth - 2];			\
+    obj_t a = argv[0], b = argv[1];					\
+    argv[0] = mintp(a) && mintp(b)? (expr) : fn(a, b);			\
+    value_depth--;							\
+    NEXT;								\
+  }
+
+#define CHECKED(fn, overflows) {					\
+    obj_t *argv = &value_stack[value_depth - 2];			\
+    obj_t a = argv[0], b = argv[1];					\
+    mint_t r;								\
+    argv[0] = mintp(a) && mintp(b) && !(overflows)?			\
+      (obj_t)r : fn(a, b);						\
+    value_depth--;							\
+    NEXT;								\
+  }
+
+#define TOP (value_stack[value_depth - 1])
+#define NEXT goto *dispatch[*pc++]
+
+// Runs the bytecode of a function whose parameters were bound from
+//  frame up on the binding stack, with its stack starting at bottom,
+//  the top of the value stack; or of a lexical function, whose
+//  arguments start at bottom with the function itself just below.  A
+//  tail call to another compiled function rebinds within the same
+//  frame and carries on in this loop, so the C stack doesn't grow.
+obj_t
+execute(func_t *f, size_t frame, size_t bottom) {
+  static void *const dispatch[] = {
+    [OP_CONST] = &&op_const,
+    [OP_VAR] = &&op_var,
+    [OP_POP] = &&op_pop,
+    [OP_JUMP] = &&op_jump,
+    [OP_JUMP_IF_NIL] = &&op_jump_if_nil,
+    [OP_AND] = &&op_and,
+    [OP_OR] = &&op_or,
+    [OP_SET] = &&op_set,
+    [OP_DEF] = &&op_def,
+    [OP_SPECIAL] = &&op_special,
+    [OP_EVAL] = &&op_eval,
+    [OP_CHECK_CALL] = &&op_check_call,
+    [OP_CALL] = &&op_call,
+    [OP_TAIL_CALL] = &&op_tail_call,
+    [OP_BUILTIN] = &&op_builtin,
+    [OP_PROFILE] = &&op_profile,
+    [OP_END_PROFILE] = &&op_end_profile,
+    [OP_LOCAL] = &&op_local,
+    [OP_SET_LOCAL] = &&op_set_local,
+    [OP_ENV] = &&op_env,
+    [OP_BOX] = &&op_box,
+    [OP_UNBOX] = &&op_unbox,
+    [OP_SET_BOX] = &&op_set_box,
+    [OP_CLOSURE] = &&op_closure,
+    [OP_NAPPEND] = &&op_nappend,
+    [OP_ADD] = &&op_add,
+    [OP_SUB] = &&op_sub,
+    [OP_MUL] = &&op_mul,
+    [OP_LESS] = &&op_less,
+    [OP_GREATER] = &&op_greater,
+    [OP_LESSEQ] = &&op_lesseq,
+    [OP_GREATEREQ] = &&op_greatereq,
+    [OP_EQUAL] = &&op_equal,
+    [OP_CAR] = &&op_car,
+    [OP_CDR] = &&op_cdr,
+    [OP_NULLP] = &&op_nullp,
+    [OP_CONS] = &&op_cons,
+    [OP_RETURN] = &&op_return,
+  };
+
+  // The function being run is kept at the bottom of the stack, which
+  //  keeps it alive after a tail call, and any local slots are just
+  //  above it.  The constants are updated in place by the collector,
+  //  so they are always read afresh.
+  size_t stack;
+  if (f->lexical) {
+    stack = bottom - 1;
+    enter_lexical(f, stack);
+  } else {
+    stack = bottom;
+    push_value(make_func(f));
+  }
+  obj_t *locals = &value_stack[stack + 1];
+  bytecode_t *code = f->code;
+  obj_t *consts = code->consts;
+  const code_t *pc = code->code;
+  NEXT;
+
+ op_const:
+  push_value(consts[*pc++]);
+  NEXT;
+ op_var: {
+    sym_t *sym = as_sym(consts[*pc++]);
+    if (sym->flags & SYM_UNBOUND)
+      error(E_UNDECLARED, make_sym(sym));
+    push_value(sym->val);
+    NEXT;
+  }
+ op_pop:
+  value_depth--;
+  NEXT;
+ op_jump:
+  pc = code->code + *pc;
+  NEXT;
+ op_jump_if_nil:
+  if (nullp(value_stack[--value_depth]))
+    pc = code->code + *pc;
+  else pc++;
+  NEXT;
+ op_and:
+  if (nullp(TOP))
+    pc = code->code + *pc;
+  else {
+    value_depth--;
+    pc++;
+  }
+  NEXT;
+ op_or:
+  if (!nullp(TOP))
+    pc = code->code + *pc;
+  else {
+    value_depth--;
+    pc++;
+  }
+  NEXT;
+ op_set:
+  set_sym(consts[*pc], TOP);
+  TOP = consts[*pc++];
+  NEXT;
+ op_def:
+  def_sym(consts[*pc], TOP);
+  TOP = consts[*pc++];
+  NEXT;
+ op_special: {
+    obj_t ret = as_special(as_func(consts[pc[0]]))(consts[pc[1]]);
+    push_value(ret);
+    pc += 2;
+    NEXT;
+  }
+ op_eval: {
+    obj_t ret = eval(consts[*pc++]);
+    push_value(ret);
+    NEXT;
+  }
+ op_check_call: {
+    // The function stays on the stack, so it's kept alive.
+    obj_t fn = TOP;
+    if (!funcp(fn)) error(E_NO_FUNCTION, fn);
+    enum ftype type = getftype(as_func(fn));
+    if (type == FTYPE_SPECIAL || type == FTYPE_MACRO) {
+      if (!consp(consts[pc[0]]))
+	error(E_LEXICAL, consts[pc[0]]);
+      obj_t ret = funcall(fn, consts[pc[0]]);
+      TOP = ret;
+      pc = code->code + pc[1];
+    } else pc += 2;
+    NEXT;
+  }
+ op_call: {
+    size_t base = value_depth - pc[0];
+    func_t *callee = as_func(value_stack[base - 1]);
+    push_frame(callee, consts[pc[1]]);
+    pc += 2;
+    obj_t ret = getftype(callee) == FTYPE_COMPILED?
+      call_builtin(callee, base) : call_lambda_values(callee, base);
+    pop_frame();
+    value_stack[base - 1] = ret;
+    NEXT;
+  }
+ op_tail_call: {
+    size_t base = value_depth - pc[0];
+    func_t *callee = as_func(value_stack[base - 1]);
+    if (getftype(callee) == FTYPE_COMPILED || !ready_to_execute(callee))
+      goto op_call;
+
+    // A lexical callee leaves the caller's bindings in place, since
+    //  its free variables are dynamic and it would see them through a
+    //  call that isn't a tail call.  They're rebound in place by any
+    //  dynamic function it tail calls in turn.
+    replace_frame(callee, consts[pc[1]]);
+    value_stack[stack] = make_func(callee);
+    if (callee->lexical) {
+      size_t argc = value_depth - base;
+      memmove(locals, &value_stack[base], sizeof(obj_t) * argc);
+      value_depth = stack + 1 + argc;
+      enter_lexical(callee, stack);
+    } else {
+      bind_values(callee, base, frame);
+      value_depth = stack + 1;
+    }
+    f = callee;
+    code = f->code;
+    consts = code->consts;
+    pc = code->code;
+    NEXT;
+  }
+ op_builtin: {
+    size_t base = value_depth - pc[1];
+    push_frame(as_func(consts[pc[0]]), nil);
+    obj_t ret = call_builtin(as_func(consts[pc[0]]), base);
+    pop_frame();
+    push_value(ret);
+    pc += 2;
+    NEXT;
+  }
+ op_profile:
+  push_value(start_tracing()? t : nil);
+  NEXT;
+ op_end_profile: {
+    obj_t ret = value_stack[--value_depth];
+    if (!nullp(TOP)) stop_tracing();
+    TOP = ret;
+    NEXT;
+  }
+
+ op_local:
+  push_value(locals[*pc++]);
+  NEXT;
+ op_set_local:
+  locals[*pc++] = value_stack[--value_depth];
+  NEXT;
+ op_env:
+  push_value(as_vector(f->env)->slots[*pc++]);
+  NEXT;
+ op_box: {
+    obj_t box = cons(locals[*pc], nil);
+    locals[*pc++] = box;
+    NEXT;
+  }
+ op_unbox:
+  TOP = as_cons(TOP)->car;
+  NEXT;
+ op_set_box: {
+    obj_t val = value_stack[--value_depth];
+    rplaca(value_stack[--value_depth], val);
+    NEXT;
+  }
+ op_closure: {
+    // The captured values stay on the stack until the env holds them,
+    //  and the env is protected until the closure does.
+    size_t n = pc[1];
+    func_t *template = as_func(consts[pc[0]]);
+    vector_t *vec = alloc_vector(n + 1);
+    vec->slots[0] = make_func(template);
+    for (size_t i = 0; i < n; i++)
+      vector_set(vec, i + 1, value_stack[value_depth - n + i]);
+    obj_t env = make_vector(vec);
+    protect(&env);
+    func_t *closure = alloc_func();
+    unprotect(1);
+    *closure = *template;
+    closure->env = env;
+    write_barrier(make_func(closure), make_cons(as_interp(closure)));
+    value_depth -= n;
+    push_value(make_func(closure));
+    pc += 2;
+    NEXT;
+  }
+ op_nappend: {
+    obj_t rest = value_stack[--value_depth];
+    TOP = nappend(TOP, rest);
+    NEXT;
+  }
+
+ op_add: CHECKED(fn2_add, __builtin_add_overflow(a.mint, b.mint, &r));
+ op_sub: CHECKED(fn2_sub, __builtin_sub_overflow(a.mint, b.mint, &r));
+ op_mul: CHECKED(fn2_mul, __builtin_mul_overflow(as_mint(a), b.mint, &r));
+ op_less: BINARY(fn2_less, a.mint < b.mint? t : nil);
+ op_greater: BINARY(fn2_greater, a.mint > b.mint? t : nil);
+ op_lesseq: BINARY(fn2_lesseq, a.mint <= b.mint? t : nil);
+ op_greatereq: BINARY(fn2_greatereq, a.mint >= b.mint? t : nil);
+ op_equal: {
+    obj_t a = value_stack[value_depth - 2], b = TOP;
+    value_depth--;
+    TOP = eqp(a, b)? t : fn2_equal(a, b);
+    NEXT;
+  }
+
+ op_car:
+  TOP = car(TOP);
+  NEXT;
+ op_cdr:
+  TOP = cdr(TOP);
+  NEXT;
+ op_nullp:
+  TOP = nullp(TOP)? t : nil;
+  NEXT;
+ op_cons: {
+    obj_t ret = cons(value_stack[value_depth - 2], TOP);
+    value_depth--;
+    TOP = ret;
+    NEXT;
+  }
+
+ op_return: {
+    obj_t ret = value_stack[--value_depth];
+    value_depth = bottom;
+    return ret;
+  }
+}